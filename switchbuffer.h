@@ -1,26 +1,245 @@
 #ifndef SWITCHBUFFER_H
 #define SWITCHBUFFER_H
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <future>
+#include <iterator>
 #include <memory>
+#include <type_traits>
+#if __cplusplus >= 201703L
+# if __has_include(<memory_resource>)
+#  include <memory_resource>
+#  define SWITCHBUFFER_PMR
+# endif
+# if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#  include <coroutine>
+#  define SWITCHBUFFER_COROUTINE
+# endif
+#endif // __cplusplus >= 201703L
+
+// let consumers signal readiness via an eventfd, e.g. for epoll
+#if defined(__linux__) && !defined(SWITCHBUFFER_NO_EVENTFD)
+# define SWITCHBUFFER_EVENTFD
+#endif
+
+#ifdef SWITCHBUFFER_PMR
+/// source of all memory of a SwitchBuffer
+using SwitchBufferMemoryResource = std::pmr::memory_resource;
+#else
+/// @brief  source of all memory of a SwitchBuffer
+/// @note  stand-in for std::pmr::memory_resource with the same interface,
+///        so a derived resource compiles either way
+class SwitchBufferMemoryResource
+{
+public:
+  virtual ~SwitchBufferMemoryResource() = default;
+
+  void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+  {
+    return do_allocate(bytes, alignment);
+  }
+
+  void deallocate(void *p, size_t bytes, size_t alignment = alignof(std::max_align_t))
+  {
+    do_deallocate(p, bytes, alignment);
+  }
+
+  bool is_equal(SwitchBufferMemoryResource const &other) const noexcept
+  {
+    return do_is_equal(other);
+  }
+
+private:
+  virtual void *do_allocate(size_t bytes, size_t alignment) = 0;
+  virtual void do_deallocate(void *p, size_t bytes, size_t alignment) = 0;
+  virtual bool do_is_equal(SwitchBufferMemoryResource const &other) const noexcept = 0;
+};
+#endif // SWITCHBUFFER_PMR
 
 namespace detail
 {
-  template<typename Buffer>
+  template<typename Buffer, size_t RingSize>
   struct SwitchBufferImpl;
+
+  /// key to an element of a SlotMap
+  struct SlotKey
+  {
+    std::uint32_t index;
+    std::uint32_t generation;
+  };
+  /// forward iterator over an array of pointers, dereferencing twice
+  template<typename T>
+  class IndirectIterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename std::remove_const<T>::type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = T &;
+
+    explicit IndirectIterator(T *const *pos = nullptr) noexcept
+      : m_pos(pos)
+    {}
+
+    reference operator*() const noexcept
+    {
+      return **m_pos;
+    }
+
+    pointer operator->() const noexcept
+    {
+      return *m_pos;
+    }
+
+    IndirectIterator &operator++() noexcept
+    {
+      ++m_pos;
+      return *this;
+    }
+
+    IndirectIterator operator++(int) noexcept
+    {
+      auto const tmp = *this;
+      ++m_pos;
+      return tmp;
+    }
+
+    bool operator==(IndirectIterator const &other) const noexcept
+    {
+      return (m_pos == other.m_pos);
+    }
+
+    bool operator!=(IndirectIterator const &other) const noexcept
+    {
+      return (m_pos != other.m_pos);
+    }
+
+  private:
+    T *const *m_pos;
+  };
 } // namespace detail
 
-template<typename Buffer>
+/// @brief  SwitchBuffer of Buffer type with a ring of either RingSize buffers
+///         or, if RingSize is 0, a size given at runtime
+template<typename Buffer, size_t RingSize = 0U>
 class SwitchBuffer;
 
+/// number of producers a SwitchBuffer hands out
+enum class ProducerMode
+{
+  Single, ///< one producer, publishing without atomic read-modify-write operations
+  Multi ///< any number of producers, claiming slots by atomic ticket and publishing in claim order
+};
+
+/// what the producers do about a consumer falling a whole ring behind
+enum class ConsumerMode
+{
+  Lossy, ///< overwrite the buffers the consumer has yet to consume
+  Reliable ///< wait for the consumer to consume them, or fail to switch if trying only
+};
+
+/// status of a consumer switch that does not use a future
+enum class SwitchStatus
+{
+  Ready, ///< a buffer is available for consumption
+  Closed, ///< the producer has shut down and all buffers are consumed
+  Empty ///< no buffer available yet, see TrySwitch, or in time, see SwitchFor
+};
+
+/// how a consumer waits in SwitchWait while the ring is empty
+struct WaitStrategy
+{
+  enum Mode
+  {
+    BusySpin, ///< spin with a CPU pause hint until the producer publishes
+    SpinYield, ///< spin up to spinCount times, then yield the thread between checks
+    SpinPark, ///< spin up to spinCount times, then block until woken by the producer
+    TimedPark ///< spin up to spinCount times, then sleep parkInterval between checks
+              ///< without ever costing the producer a wakeup
+  };
+
+  Mode mode;
+  unsigned int spinCount; ///< number of checks before yielding or parking
+  std::chrono::microseconds parkInterval; ///< sleep duration between checks in TimedPark mode
+
+  WaitStrategy(Mode mode = SpinPark, unsigned int spinCount = 0U,
+      std::chrono::microseconds parkInterval = std::chrono::microseconds(100))
+    : mode(mode)
+    , spinCount(spinCount)
+    , parkInterval(parkInterval)
+  {}
+};
+
+#ifdef SWITCHBUFFER_COROUTINE
+/// @brief  resumes a coroutine suspended on an empty ring, e.g. by posting it to an executor
+/// @note  called by the producer publishing or shutting down, outside of any SwitchBuffer lock
+using ResumeFunction = void (*)(std::coroutine_handle<> handle, void *context);
+#endif // SWITCHBUFFER_COROUTINE
+
+/// @brief  counters of consumer activity, see SwitchBufferConsumer::GetStatistics
+/// @note  counted only if SWITCHBUFFER_STATISTICS is defined, all zero otherwise
+struct ConsumerStatistics
+{
+  std::uint64_t consumed; ///< buffers handed to the consumer
+  std::uint64_t overwritten; ///< buffers overwritten by the producer before the consumer got to them
+  std::uint64_t skipped; ///< buffers discarded by skipping to the most recent buffer
+  std::uint64_t blocked; ///< waits on an empty ring, including futures not ready at once
+  std::chrono::nanoseconds blockedTime; ///< total duration of these waits
+};
+
 /// @brief  interface to pass to the producer:
 ///         provides non-blocking access to the underlying buffers
 ///         and publishes to the consumers
 /// @note  create via the SwitchBuffer class
-template<typename Buffer>
+template<typename Buffer, size_t RingSize = 0U>
 class SwitchBufferProducer
 {
-  friend class SwitchBuffer<Buffer>;
+  friend class SwitchBuffer<Buffer, RingSize>;
+
+public:
+  /// writable buffers as returned by SwitchBatch, valid until the next switch
+  class Batch
+  {
+    friend class SwitchBufferProducer;
+
+  public:
+    using iterator = detail::IndirectIterator<Buffer>;
+
+  public:
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+
+    Buffer &operator[](size_t pos) const noexcept
+    {
+      return *m_buffers[pos];
+    }
+
+    iterator begin() const noexcept
+    {
+      return iterator(m_buffers);
+    }
+
+    iterator end() const noexcept
+    {
+      return iterator(m_buffers + m_size);
+    }
+
+  private:
+    Batch(Buffer *const *buffers, size_t size) noexcept
+      : m_buffers(buffers)
+      , m_size(size)
+    {}
+
+  private:
+    Buffer *const *m_buffers;
+    size_t m_size;
+  };
 
 public:
   SwitchBufferProducer(SwitchBufferProducer const &) = delete;
@@ -31,24 +250,144 @@ public:
   SwitchBufferProducer &operator=(SwitchBufferProducer &&other) noexcept;
 
   /// @brief  get a writable buffer to produce into
-  /// @note  all but the initial call also publish the previous buffer to the consumers
+  /// @note  all but the initial call also publish the previous buffer to the consumers;
+  ///        waits while the buffer would overwrite one a reliable consumer has yet to consume
   Buffer &Switch();
 
+  /// @brief  like Switch, returning nullptr instead of waiting for a reliable consumer
+  /// @note  publishes the previous buffer either way; retry later to get a buffer
+  Buffer *TrySwitch();
+
+  /// @brief  like Switch, with the previous content of the buffer reset in place for reuse,
+  ///         e.g. clearing a container while keeping its capacity
+  /// @param[in]  reset  callable as reset(Buffer &), skipped for buffers default-constructed on first use
+  template<typename ResetFunction>
+  Buffer &Switch(ResetFunction &&reset);
+
+  /// @brief  like Switch, with the buffer destroyed and constructed in place from args
+  /// @note  unlike the other switches, this does not require Buffer to be default-constructible;
+  ///        if the constructor throws, the slot is published empty and skipped by the consumers
+  template<typename... Args>
+  Buffer &Emplace(Args&&... args);
+
+  /// @brief  get count writable buffers to produce into, to be published at once
+  /// @param[in]  count  number of buffers, between 1 and ring buffer size - 1
+  /// @note  like Switch, all but the initial call also publish the previous buffers to the consumers,
+  ///        with a single synchronization and notification of the consumers
+  Batch SwitchBatch(size_t count);
+
+  /// @brief  publish the previous buffers without getting new ones
+  /// @note  in multi-producer mode, buffers are published in the order they were claimed,
+  ///        so a producer holding on to its buffers delays those of the other producers;
+  ///        call this when going idle instead of keeping the buffers until the next switch
+  void Publish();
+
 private:
   /// created by SwitchBuffer only
-  SwitchBufferProducer(std::shared_ptr<detail::SwitchBufferImpl<Buffer>> impl);
+  SwitchBufferProducer(std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> impl);
 
 private:
-  std::shared_ptr<detail::SwitchBufferImpl<Buffer>> m_impl;
+  std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> m_impl;
+  typename detail::SwitchBufferImpl<Buffer, RingSize>::Producer m_state; // producer state within m_impl
 };
 
 /// @brief  interface to pass to a consumer:
 ///         provides possibly-blocking access to the underlying buffers via Switch method
 /// @note  create via the SwitchBuffer class
-template<typename Buffer>
+template<typename Buffer, size_t RingSize = 0U>
 class SwitchBufferConsumer
 {
-  friend class SwitchBuffer<Buffer>;
+  friend class SwitchBuffer<Buffer, RingSize>;
+
+public:
+  /// readable buffer as returned by SwitchWait
+  struct Result
+  {
+    SwitchStatus status;
+    Buffer const *buffer; ///< valid until the next switch if Ready, nullptr otherwise
+    std::uint64_t sequence; ///< sequence number of the buffer if Ready, see GetSequence
+
+    explicit operator bool() const noexcept
+    {
+      return (status == SwitchStatus::Ready);
+    }
+  };
+
+  /// readable buffers in production order as returned by SwitchBatch, valid until the next switch
+  class Batch
+  {
+    friend class SwitchBufferConsumer;
+
+  public:
+    using const_iterator = detail::IndirectIterator<Buffer const>;
+
+  public:
+    SwitchStatus status;
+
+    explicit operator bool() const noexcept
+    {
+      return (status == SwitchStatus::Ready);
+    }
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+
+    bool empty() const noexcept
+    {
+      return (m_size == 0U);
+    }
+
+    Buffer const &operator[](size_t pos) const noexcept
+    {
+      return *m_buffers[pos];
+    }
+
+    /// sequence number of the buffer at pos, see GetSequence
+    std::uint64_t sequence(size_t pos) const noexcept
+    {
+      return m_sequences[pos];
+    }
+
+    const_iterator begin() const noexcept
+    {
+      return const_iterator(m_buffers);
+    }
+
+    const_iterator end() const noexcept
+    {
+      return const_iterator(m_buffers + m_size);
+    }
+
+  private:
+    Buffer const *const *m_buffers = nullptr;
+    std::uint64_t const *m_sequences = nullptr;
+    size_t m_size = 0U;
+  };
+
+#ifdef SWITCHBUFFER_COROUTINE
+  /// awaitable as returned by Next, resulting in a Result like SwitchWait
+  class Awaiter
+  {
+    friend class SwitchBufferConsumer;
+
+  public:
+    bool await_ready();
+    bool await_suspend(std::coroutine_handle<> handle);
+    Result await_resume();
+
+  private:
+    Awaiter(SwitchBufferConsumer *consumer, bool skipToMostRecent) noexcept
+      : m_consumer(consumer)
+      , m_skipToMostRecent(skipToMostRecent)
+    {}
+
+  private:
+    SwitchBufferConsumer *m_consumer;
+    bool m_skipToMostRecent;
+  };
+#endif // SWITCHBUFFER_COROUTINE
 
 public:
   SwitchBufferConsumer(SwitchBufferConsumer const &) = delete;
@@ -64,24 +403,144 @@ public:
   ///                               permanently skip all intermediates
   std::future<Buffer const &> Switch(bool skipToMostRecent = false);
 
+  /// @brief  get a readable buffer to consume from without allocating a future
+  /// @param[in]  skipToMostRecent  see Switch
+  /// @note  returns immediately if a buffer is available and
+  ///        only waits on an empty ring, according to the wait strategy
+  Result SwitchWait(bool skipToMostRecent = false);
+
+  /// @brief  get a readable buffer to consume from if one is available, without ever waiting
+  /// @param[in]  skipToMostRecent  see Switch
+  /// @note  returns Empty on an empty ring, keeping the previous buffer and not setting up a promise
+  Result TrySwitch(bool skipToMostRecent = false);
+
+  /// @brief  like SwitchWait, waiting on an empty ring for at most timeout
+  /// @param[in]  skipToMostRecent  see Switch
+  /// @note  returns Empty on timeout, with the previous buffer released
+  template<typename Rep, typename Period>
+  Result SwitchFor(std::chrono::duration<Rep, Period> const &timeout, bool skipToMostRecent = false);
+
+  /// @brief  like SwitchWait, waiting on an empty ring until deadline at the latest
+  /// @param[in]  skipToMostRecent  see Switch
+  /// @note  returns Empty on timeout, with the previous buffer released
+  template<typename Clock, typename Duration>
+  Result SwitchUntil(std::chrono::time_point<Clock, Duration> const &deadline, bool skipToMostRecent = false);
+
+  /// @brief  get all currently readable buffers at once, from the next in the queue to the most recent
+  /// @note  acquires and releases the buffers as one unit, amortizing the synchronization;
+  ///        waits on an empty ring like SwitchWait
+  Batch SwitchBatch();
+
+  /// @brief  get the sequence number of the buffer the last successful switch returned,
+  ///         e.g. once the future of Switch is ready, or the last buffer of a batch
+  /// @note  published buffers are numbered consecutively from 0, so a consumer detects
+  ///        buffers it missed by overwrite or skipping as gaps between the sequence numbers
+  std::uint64_t GetSequence() const;
+
+  /// set how SwitchWait waits on an empty ring
+  void SetWaitStrategy(WaitStrategy waitStrategy) noexcept;
+
+#ifdef SWITCHBUFFER_COROUTINE
+  /// @brief  get a readable buffer to consume from via co_await, suspending on an empty ring
+  /// @param[in]  skipToMostRecent  see Switch
+  /// @note  like a fulfilled future, the suspended coroutine continues with the most recent buffer;
+  ///        it is resumed by the producer thread unless a resume function is set
+  Awaiter Next(bool skipToMostRecent = false);
+
+  /// @brief  set how a coroutine suspended in Next is resumed
+  /// @param[in]  resume  called with the coroutine handle and context, nullptr to resume inline
+  void SetResumeFunction(ResumeFunction resume, void *context = nullptr) noexcept;
+#endif // SWITCHBUFFER_COROUTINE
+
+#ifdef SWITCHBUFFER_EVENTFD
+  /// @brief  get a file descriptor to multiplex the consumer with others via poll or epoll
+  /// @note  the descriptor is readable while a buffer is available to the next switch or
+  ///        the producer has shut down, and is reset by the switches; do not read or close it.
+  ///        Created on first call and closed with the consumer. Once created, every
+  ///        publication takes the consumer registry mutex, and a write syscall whenever
+  ///        the descriptor turns readable.
+  int GetFileDescriptor();
+#endif // SWITCHBUFFER_EVENTFD
+
+  /// get a snapshot of the counters of this consumer
+  ConsumerStatistics GetStatistics() const;
+
+private:
+  /// created by SwitchBuffer only
+  SwitchBufferConsumer(std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> impl,
+    WaitStrategy waitStrategy, ConsumerMode consumerMode);
+
+private:
+  std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> m_impl;
+  detail::SlotKey m_key; // handle to the consumer state within m_impl
+  WaitStrategy m_waitStrategy;
+#ifdef SWITCHBUFFER_COROUTINE
+  ResumeFunction m_resume;
+  void *m_resumeContext;
+#endif // SWITCHBUFFER_COROUTINE
+};
+
+/// @brief  interface to keep a callback registered as consumer:
+///         the callback is invoked with each published buffer by the producer thread,
+///         or by a delivery thread of its own once it exceeded its time budget
+/// @note  create via the SwitchBuffer class
+template<typename Buffer, size_t RingSize = 0U>
+class SwitchBufferCallbackConsumer
+{
+  friend class SwitchBuffer<Buffer, RingSize>;
+
+public:
+  /// callable with a buffer that is valid during the call, must not throw
+  using Function = std::function<void(Buffer const &)>;
+
+public:
+  SwitchBufferCallbackConsumer(SwitchBufferCallbackConsumer const &) = delete;
+  SwitchBufferCallbackConsumer(SwitchBufferCallbackConsumer &&other) = delete;
+  /// unregister the callback, waiting for a running invocation to return
+  ~SwitchBufferCallbackConsumer();
+
+  SwitchBufferCallbackConsumer &operator=(SwitchBufferCallbackConsumer const &) = delete;
+  SwitchBufferCallbackConsumer &operator=(SwitchBufferCallbackConsumer &&other) = delete;
+
+  /// check whether the callback has been demoted to its own delivery thread
+  bool IsDemoted() const noexcept;
+
 private:
   /// created by SwitchBuffer only
-  SwitchBufferConsumer(std::shared_ptr<detail::SwitchBufferImpl<Buffer>> impl);
+  SwitchBufferCallbackConsumer(std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> impl,
+    Function callback, std::chrono::nanoseconds budget);
 
 private:
-  std::shared_ptr<detail::SwitchBufferImpl<Buffer>> m_impl;
+  std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> m_impl;
+  typename detail::SwitchBufferImpl<Buffer, RingSize>::Callback m_state; // callback state registered with m_impl
 };
 
 /// SwitchBuffer master interface to distribute producer and consumer interfaces
-template<typename Buffer>
+template<typename Buffer, size_t RingSize>
 class SwitchBuffer
 {
 public:
-  using Producer = typename std::unique_ptr<SwitchBufferProducer<Buffer>>;
-  using Consumer = typename std::unique_ptr<SwitchBufferConsumer<Buffer>>;
+  using Producer = typename std::unique_ptr<SwitchBufferProducer<Buffer, RingSize>>;
+  using Consumer = typename std::unique_ptr<SwitchBufferConsumer<Buffer, RingSize>>;
+  using CallbackConsumer = typename std::unique_ptr<SwitchBufferCallbackConsumer<Buffer, RingSize>>;
 
 public:
-  SwitchBuffer(size_t ringBufferSize);
+  /// @brief  create with a ring of compile-time size RingSize
+  /// @param[in]  producerMode  whether GetProducer may be called more than once
+  /// @param[in]  memoryResource  source of the ring and all other shared state, e.g. a pre-faulted pool;
+  ///                             the default resource if nullptr, must outlive all interfaces otherwise
+  explicit SwitchBuffer(ProducerMode producerMode = ProducerMode::Single,
+    SwitchBufferMemoryResource *memoryResource = nullptr);
+
+  /// @brief  create with a ring of runtime size, if RingSize is 0
+  /// @param[in]  ringBufferSize  number of buffers in the ring, at least 2
+  /// @param[in]  powerOfTwo  true to require a power of two ringBufferSize
+  ///                         in exchange for ring index arithmetic without division
+  /// @param[in]  producerMode  whether GetProducer may be called more than once
+  /// @param[in]  memoryResource  see above
+  SwitchBuffer(size_t ringBufferSize, bool powerOfTwo = false,
+    ProducerMode producerMode = ProducerMode::Single,
+    SwitchBufferMemoryResource *memoryResource = nullptr);
   SwitchBuffer(SwitchBuffer const &) = delete;
   SwitchBuffer(SwitchBuffer &&other) noexcept;
   ~SwitchBuffer();
@@ -89,14 +548,32 @@ public:
   SwitchBuffer &operator=(SwitchBuffer const &) = delete;
   SwitchBuffer &operator=(SwitchBuffer &&other) noexcept;
 
-  /// get an interface to pass to the producer
+  /// @brief  get an interface to pass to the producer
+  /// @note  in multi-producer mode, each call returns another producer;
+  ///        the consumers see the buffer closed once all producers are gone
   Producer GetProducer();
 
-  /// get an interface to pass to a consumer
-  Consumer GetConsumer();
+  /// @brief  get an interface to pass to a consumer
+  /// @param[in]  waitStrategy  how the consumer waits in SwitchWait on an empty ring
+  /// @param[in]  consumerMode  whether the producers may overwrite buffers the consumer has yet to consume;
+  ///                           a reliable consumer gets every buffer published from its creation on
+  ///                           unless skipping, and throttles the producers to its pace
+  Consumer GetConsumer(WaitStrategy waitStrategy = WaitStrategy(),
+    ConsumerMode consumerMode = ConsumerMode::Lossy);
+
+  /// @brief  register a callback as consumer of the buffers published from now on
+  /// @param[in]  callback  invoked with each buffer in production order, skipping overwritten ones
+  /// @param[in]  budget  duration of a single invocation beyond which the callback is no longer
+  ///                     invoked by the producer thread, but by a delivery thread of its own
+  /// @note  inline callbacks delay the producer and should be trivial, e.g. updating a counter
+  CallbackConsumer GetCallbackConsumer(typename SwitchBufferCallbackConsumer<Buffer, RingSize>::Function callback,
+    std::chrono::nanoseconds budget = std::chrono::nanoseconds::max());
+
+  /// get a snapshot of the counters of all consumers, including the ones already gone
+  ConsumerStatistics GetStatistics() const;
 
 private:
-  std::shared_ptr<detail::SwitchBufferImpl<Buffer>> m_impl;
+  std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> m_impl;
   Producer m_producer;
 };
 
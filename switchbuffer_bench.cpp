@@ -0,0 +1,276 @@
+#include "switchbuffer.h"
+
+#include <algorithm>       // for std::sort
+#include <array>           // for std::array
+#include <atomic>          // for std::atomic
+#include <chrono>          // for std::chrono::steady_clock
+#include <cstdint>         // for std::uint64_t
+#include <cstring>         // for std::memcpy
+#include <iomanip>         // for std::setw
+#include <iostream>        // for std::cout
+#include <thread>          // for std::thread
+#include <vector>          // for std::vector
+
+#define ITERATIONS 10000000U
+#define OP_ITERATIONS 1000000U
+#define THREADED_ITERATIONS 200000U
+#define LATENCY_SAMPLES 20000U
+#define LATENCY_INTERVAL_US 20U
+#define RING_SIZE 64U
+
+using namespace std;
+using BufferContent = unsigned int;
+using Buffer = SwitchBuffer<BufferContent>;
+using Clock = chrono::steady_clock;
+
+/// buffer of Size bytes starting with a timestamp or sequence number
+template<size_t Size>
+using Payload = array<char, Size>;
+
+template<size_t Size>
+void Stamp(Payload<Size> &payload, uint64_t value)
+{
+  static_assert(Size >= sizeof(uint64_t), "payload too small");
+
+  // only touch the head to measure the switch rather than the copy
+  memcpy(payload.data(), &value, sizeof(value));
+}
+
+template<size_t Size>
+uint64_t Stamp(Payload<Size> const &payload)
+{
+  uint64_t value;
+  memcpy(&value, payload.data(), sizeof(value));
+  return value;
+}
+
+uint64_t Now()
+{
+  return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(
+    Clock::now().time_since_epoch()).count());
+}
+
+double NsPerOp(Clock::duration elapsed, size_t ops)
+{
+  return chrono::duration<double, nano>(elapsed).count() / ops;
+}
+
+/// Measure the cost of a producer Switch followed by a consumer SwitchWait in a single thread
+template<typename SBuf>
+double MeasureSwitch(SBuf &sbuf)
+{
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  BufferContent sum{};
+  producer->Switch() = 0U;
+
+  auto const start = Clock::now();
+  for (unsigned int i = 0U; i < ITERATIONS; ++i) {
+    producer->Switch() = i;
+    sum += *consumer->SwitchWait().buffer;
+  }
+  auto const stop = Clock::now();
+
+  // keep the loop from being optimized away
+  if (sum == 1U)
+    cout << "";
+
+  return NsPerOp(stop - start, ITERATIONS);
+}
+
+struct OpCosts
+{
+  double producer; // ns per producer Switch
+  double consumer; // ns per consumer Switch, via future
+  double consumerWait; // ns per consumer SwitchWait
+};
+
+/// Measure the cost of single producer and consumer switches in a single thread,
+/// with further consumers attached that do not consume
+template<size_t Size>
+OpCosts MeasureOps(size_t ringSize, size_t consumerCount)
+{
+  SwitchBuffer<Payload<Size>> sbuf(ringSize);
+  auto producer = sbuf.GetProducer();
+  vector<typename SwitchBuffer<Payload<Size>>::Consumer> consumers;
+  for (size_t i = 0U; i < consumerCount; ++i)
+    consumers.push_back(sbuf.GetConsumer());
+
+  OpCosts costs;
+  uint64_t sum{};
+
+  auto start = Clock::now();
+  for (uint64_t i = 0U; i < OP_ITERATIONS; ++i)
+    Stamp(producer->Switch(), i);
+  costs.producer = NsPerOp(Clock::now() - start, OP_ITERATIONS);
+
+  // fill the ring, then drain it, timing the draining only
+  auto const perRound = ringSize - 1U;
+  auto const rounds = OP_ITERATIONS / perRound;
+  Clock::duration futureElapsed{};
+  Clock::duration waitElapsed{};
+  for (size_t round = 0U; round < rounds; ++round) {
+    for (size_t i = 0U; i < perRound; ++i)
+      Stamp(producer->Switch(), i);
+    (void)producer->Switch();
+
+    auto &&consumer = consumers.front();
+    start = Clock::now();
+    if (round % 2U) {
+      for (size_t i = 0U; i < perRound; ++i)
+        sum += Stamp(consumer->Switch().get());
+      futureElapsed += Clock::now() - start;
+    } else {
+      for (size_t i = 0U; i < perRound; ++i)
+        sum += Stamp(*consumer->SwitchWait().buffer);
+      waitElapsed += Clock::now() - start;
+    }
+  }
+  costs.consumer = NsPerOp(futureElapsed, (rounds / 2U) * perRound);
+  costs.consumerWait = NsPerOp(waitElapsed, ((rounds + 1U) / 2U) * perRound);
+
+  // keep the loops from being optimized away
+  if (sum == 1U)
+    cout << "";
+
+  return costs;
+}
+
+struct Throughput
+{
+  double producer; // million producer switches per second
+  double consumed; // share of the published buffers seen by the average consumer
+};
+
+/// Measure the producer saturating the ring with all consumers draining it concurrently
+template<size_t Size>
+Throughput MeasureThroughput(size_t ringSize, size_t consumerCount)
+{
+  atomic<uint64_t> consumed(0U);
+  vector<thread> threads;
+  Clock::duration elapsed;
+  {
+    SwitchBuffer<Payload<Size>> sbuf(ringSize);
+    for (size_t i = 0U; i < consumerCount; ++i) {
+      threads.emplace_back([&consumed](typename SwitchBuffer<Payload<Size>>::Consumer consumer) {
+        uint64_t count = 0U;
+        while (consumer->SwitchWait())
+          ++count;
+        consumed += count;
+      }, sbuf.GetConsumer());
+    }
+
+    auto producer = sbuf.GetProducer();
+    auto const start = Clock::now();
+    for (uint64_t i = 0U; i < THREADED_ITERATIONS; ++i)
+      Stamp(producer->Switch(), i);
+    (void)producer->Switch();
+    elapsed = Clock::now() - start;
+  }
+  for (auto &&t : threads)
+    t.join();
+
+  Throughput throughput;
+  throughput.producer = THREADED_ITERATIONS / chrono::duration<double, micro>(elapsed).count();
+  throughput.consumed = static_cast<double>(consumed) / consumerCount / THREADED_ITERATIONS;
+  return throughput;
+}
+
+struct Latency
+{
+  double p50; // publish-to-observe latency percentiles in microseconds
+  double p99;
+  double p999;
+};
+
+/// Measure the time from publishing a buffer to a consumer observing it, with a paced producer
+template<size_t Size>
+Latency MeasureLatency(size_t ringSize, size_t consumerCount)
+{
+  vector<vector<uint64_t>> samples(consumerCount);
+  vector<thread> threads;
+  {
+    SwitchBuffer<Payload<Size>> sbuf(ringSize);
+    for (size_t i = 0U; i < consumerCount; ++i) {
+      threads.emplace_back([](typename SwitchBuffer<Payload<Size>>::Consumer consumer, vector<uint64_t> &latencies) {
+        latencies.reserve(LATENCY_SAMPLES);
+        while (auto const result = consumer->SwitchWait()) {
+          auto const now = Now();
+          latencies.push_back(now - Stamp(*result.buffer));
+        }
+      }, sbuf.GetConsumer(WaitStrategy(WaitStrategy::SpinPark, 1000U)), ref(samples[i]));
+    }
+
+    auto producer = sbuf.GetProducer();
+    auto buffer = &producer->Switch();
+    for (unsigned int i = 0U; i < LATENCY_SAMPLES; ++i) {
+      auto const next = Clock::now() + chrono::microseconds(LATENCY_INTERVAL_US);
+      while (Clock::now() < next)
+        this_thread::yield();
+
+      // stamp right before publishing with the next switch
+      Stamp(*buffer, Now());
+      buffer = &producer->Switch();
+    }
+  }
+  for (auto &&t : threads)
+    t.join();
+
+  vector<uint64_t> all;
+  for (auto &&latencies : samples)
+    all.insert(end(all), begin(latencies), end(latencies));
+  sort(begin(all), end(all));
+
+  auto const percentile = [&all](double p) -> double {
+    return (all.empty() ? 0.0 : all[static_cast<size_t>(p * (all.size() - 1U))] / 1000.0);
+  };
+  return Latency{percentile(0.5), percentile(0.99), percentile(0.999)};
+}
+
+template<size_t Size>
+void Sweep()
+{
+  for (size_t ringSize : {4U, 64U, 1024U}) {
+    for (size_t consumerCount : {1U, 2U, 4U, 8U, 16U}) {
+      auto const ops = MeasureOps<Size>(ringSize, consumerCount);
+      auto const throughput = MeasureThroughput<Size>(ringSize, consumerCount);
+      auto const latency = MeasureLatency<Size>(ringSize, consumerCount);
+
+      cout << setw(8) << Size << setw(6) << ringSize << setw(6) << consumerCount
+           << fixed << setprecision(1)
+           << setw(10) << ops.producer << setw(10) << ops.consumer << setw(10) << ops.consumerWait
+           << setprecision(2)
+           << setw(10) << throughput.producer << setw(9) << throughput.consumed * 100.0 << "%"
+           << setprecision(1)
+           << setw(9) << latency.p50 << setw(9) << latency.p99 << setw(9) << latency.p999 << "\n";
+    }
+  }
+}
+
+int main(int, char **)
+{
+  Buffer modulo(RING_SIZE, false);
+  Buffer bitmask(RING_SIZE, true);
+  SwitchBuffer<BufferContent, RING_SIZE> compileTime;
+
+  cout << "shared state aligned to " << detail::cacheLineSize << " bytes\n";
+  cout << "ring size " << RING_SIZE << ", " << ITERATIONS << " iterations\n";
+  cout << setw(12) << "indexing" << setw(16) << "ns/switch" << "\n";
+  cout << setw(12) << "modulo" << setw(16) << fixed << setprecision(2) << MeasureSwitch(modulo) << "\n";
+  cout << setw(12) << "bitmask" << setw(16) << fixed << setprecision(2) << MeasureSwitch(bitmask) << "\n";
+  cout << setw(12) << "static" << setw(16) << fixed << setprecision(2) << MeasureSwitch(compileTime) << "\n";
+
+  cout << "\nns/op single-threaded (" << OP_ITERATIONS << " iterations), "
+       << "throughput with concurrent consumers (" << THREADED_ITERATIONS << " switches), "
+       << "latency in us at one switch per " << LATENCY_INTERVAL_US << " us\n";
+  cout << setw(8) << "bytes" << setw(6) << "ring" << setw(6) << "cons"
+       << setw(10) << "prod" << setw(10) << "future" << setw(10) << "wait"
+       << setw(10) << "Mswitch/s" << setw(10) << "consumed"
+       << setw(9) << "p50" << setw(9) << "p99" << setw(9) << "p99.9" << "\n";
+  Sweep<8U>();
+  Sweep<256U>();
+  Sweep<4096U>();
+
+  return EXIT_SUCCESS;
+}
@@ -5,15 +5,47 @@
 # error Include this file via switchbuffer.h only
 #endif
 
+// block waiting consumers on a futex unless told to use a condition variable
+#if defined(__linux__) && !defined(SWITCHBUFFER_NO_FUTEX)
+# define SWITCHBUFFER_FUTEX
+#endif
+
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <iterator>
+#include <limits>
 #include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
 #if __cplusplus >= 201703L
 # include <optional>
 #endif // __cplusplus >= 201703L
 #include <vector>
 
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+# include <immintrin.h>
+#endif
+
+#ifdef SWITCHBUFFER_FUTEX
+# include <climits>
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif // SWITCHBUFFER_FUTEX
+
+#ifdef SWITCHBUFFER_EVENTFD
+# include <cerrno>
+# include <sys/eventfd.h>
+# include <system_error>
+# include <unistd.h>
+#endif // SWITCHBUFFER_EVENTFD
+
 namespace detail
 {
 #if __cplusplus >= 201703L
@@ -22,348 +54,2424 @@ namespace detail
   template<typename T>
   struct optional
   {
+    optional() noexcept
+      : m_hasValue(false)
+    {}
+
+    optional(optional &&other) noexcept(std::is_nothrow_move_constructible<T>::value)
+      : m_hasValue(false)
+    {
+      if (other)
+        emplace(std::move(*other));
+    }
+
+    ~optional()
+    {
+      reset();
+    }
+
+    optional &operator=(optional &&other) noexcept(std::is_nothrow_move_constructible<T>::value)
+    {
+      if (this != &other) {
+        reset();
+        if (other)
+          emplace(std::move(*other));
+      }
+      return *this;
+    }
+
     template<typename... Args>
     T &emplace(Args&&... args)
     {
-      m_ptr.reset(new T(std::forward<Args>(args)...));
-      return *m_ptr;
+      reset();
+      new (m_storage) T(std::forward<Args>(args)...);
+      m_hasValue = true;
+      return **this;
+    }
+
+    void reset() noexcept
+    {
+      if (m_hasValue) {
+        (**this).~T();
+        m_hasValue = false;
+      }
+    }
+
+    T &operator*() noexcept
+    {
+      return *reinterpret_cast<T *>(m_storage);
+    }
+
+    T *operator->() noexcept
+    {
+      return reinterpret_cast<T *>(m_storage);
+    }
+
+    operator bool() const noexcept
+    {
+      return m_hasValue;
+    }
+
+  private:
+    alignas(T) unsigned char m_storage[sizeof(T)]; // stored inline rather than allocated
+    bool m_hasValue;
+  };
+#endif // __cplusplus >= 201703L
+
+  /// hint to the CPU that the calling thread is spinning
+  inline void CpuRelax() noexcept
+  {
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+  }
+
+  // cache line size to align shared data to; a constant rather than
+  // std::hardware_destructive_interference_size, which varies with the tuning flags,
+  // as it determines the layout of the shared state and of a SharedSwitchBuffer segment
+#if defined(SWITCHBUFFER_CACHE_LINE_SIZE)
+  constexpr size_t cacheLineSize = SWITCHBUFFER_CACHE_LINE_SIZE;
+#elif defined(__APPLE__) && defined(__aarch64__)
+  constexpr size_t cacheLineSize = 128U;
+#else
+  constexpr size_t cacheLineSize = 64U;
+#endif
+
+  // alignment of state within the interfaces, allocated via plain new
+#ifdef __cpp_aligned_new
+  constexpr size_t interfaceAlignment = cacheLineSize;
+#else
+  constexpr size_t interfaceAlignment = alignof(std::max_align_t);
+#endif // __cpp_aligned_new
+
+  /// @brief  allocate storage via global new
+  /// @note  unlike operator new in C++11, this honors the alignment of over-aligned types
+  inline void *AlignedAllocate(size_t size, size_t alignment)
+  {
+    alignment = (alignment > alignof(void *) ? alignment : alignof(void *));
+
+    // store the original address right in front of the aligned storage
+    auto const storage = ::operator new(size + alignment + sizeof(void *));
+    auto const addr = reinterpret_cast<std::uintptr_t>(storage) + sizeof(void *);
+    auto const aligned = reinterpret_cast<void **>((addr + alignment - 1U) & ~(alignment - 1U));
+    aligned[-1] = storage;
+    return aligned;
+  }
+
+  inline void AlignedDeallocate(void *aligned) noexcept
+  {
+    if (aligned)
+      ::operator delete(static_cast<void **>(aligned)[-1]);
+  }
+
+#ifdef SWITCHBUFFER_PMR
+  inline SwitchBufferMemoryResource *DefaultMemoryResource() noexcept
+  {
+    return std::pmr::get_default_resource();
+  }
+#else
+  /// memory resource of global new and delete, honoring over-alignment
+  class NewDeleteResource : public SwitchBufferMemoryResource
+  {
+  private:
+    void *do_allocate(size_t bytes, size_t alignment) override
+    {
+      return AlignedAllocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, size_t, size_t) override
+    {
+      AlignedDeallocate(p);
+    }
+
+    bool do_is_equal(SwitchBufferMemoryResource const &other) const noexcept override
+    {
+      return (this == &other);
+    }
+  };
+
+  inline SwitchBufferMemoryResource *DefaultMemoryResource() noexcept
+  {
+    static NewDeleteResource resource;
+    return &resource;
+  }
+#endif // SWITCHBUFFER_PMR
+
+  /// allocator of a memory resource, optionally over-aligning
+  template<typename T>
+  struct ResourceAllocator
+  {
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    SwitchBufferMemoryResource *resource;
+    size_t alignment; // minimum alignment of the allocations, raised to that of T if necessary
+
+    explicit ResourceAllocator(SwitchBufferMemoryResource *resource, size_t alignment = 1U) noexcept
+      : resource(resource)
+      , alignment(alignment)
+    {}
+
+    template<typename U>
+    ResourceAllocator(ResourceAllocator<U> const &other) noexcept
+      : resource(other.resource)
+      , alignment(other.alignment)
+    {}
+
+    T *allocate(size_t n)
+    {
+      return static_cast<T *>(resource->allocate(n * sizeof(T), Alignment()));
+    }
+
+    void deallocate(T *p, size_t n) noexcept
+    {
+      resource->deallocate(p, n * sizeof(T), Alignment());
+    }
+
+    size_t Alignment() const noexcept
+    {
+      return (alignment > alignof(T) ? alignment : alignof(T));
+    }
+
+    template<typename U>
+    bool operator==(ResourceAllocator<U> const &other) const noexcept
+    {
+      return (resource == other.resource || resource->is_equal(*other.resource));
+    }
+
+    template<typename U>
+    bool operator!=(ResourceAllocator<U> const &other) const noexcept
+    {
+      return !(*this == other);
+    }
+  };
+
+  template<typename T>
+  using Vector = std::vector<T, ResourceAllocator<T>>;
+
+  /// fixed-size array of objects in a single cache line aligned allocation
+  template<typename T>
+  class AlignedArray
+  {
+  public:
+    template<typename... Args>
+    AlignedArray(SwitchBufferMemoryResource *resource, size_t size, Args const &... args)
+      : m_alloc(resource, cacheLineSize)
+      , m_data(m_alloc.allocate(size))
+      , m_size(0U)
+      , m_capacity(size)
+    {
+      try {
+        for (; m_size < size; ++m_size)
+          new (m_data + m_size) T(args...);
+      } catch (...) {
+        Clear();
+        throw;
+      }
+    }
+
+    AlignedArray(AlignedArray const &) = delete;
+
+    AlignedArray(AlignedArray &&other) noexcept
+      : m_alloc(other.m_alloc)
+      , m_data(other.m_data)
+      , m_size(other.m_size)
+      , m_capacity(other.m_capacity)
+    {
+      other.m_data = nullptr;
+      other.m_size = 0U;
+      other.m_capacity = 0U;
+    }
+
+    ~AlignedArray()
+    {
+      Clear();
+    }
+
+    AlignedArray &operator=(AlignedArray const &) = delete;
+
+    AlignedArray &operator=(AlignedArray &&other) noexcept
+    {
+      std::swap(m_alloc, other.m_alloc);
+      std::swap(m_data, other.m_data);
+      std::swap(m_size, other.m_size);
+      std::swap(m_capacity, other.m_capacity);
+      return *this;
+    }
+
+    T &operator[](size_t pos)
+    {
+      assert(pos < m_size);
+      return m_data[pos];
+    }
+
+    T const &operator[](size_t pos) const
+    {
+      assert(pos < m_size);
+      return m_data[pos];
+    }
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+
+  private:
+    void Clear() noexcept
+    {
+      while (m_size > 0U)
+        m_data[--m_size].~T();
+      if (m_data)
+        m_alloc.deallocate(m_data, m_capacity);
+      m_data = nullptr;
+      m_capacity = 0U;
+    }
+
+  private:
+    ResourceAllocator<T> m_alloc;
+    T *m_data;
+    size_t m_size;
+    size_t m_capacity;
+  };
+
+  /// @brief  container with stable keys for constant time access to its elements
+  /// @note  elements are stored densely for iteration and may move on Erase
+  template<typename T>
+  class SlotMap
+  {
+  public:
+    using iterator = typename Vector<T>::iterator;
+
+  public:
+    explicit SlotMap(SwitchBufferMemoryResource *resource)
+      : m_values(ResourceAllocator<T>(resource))
+      , m_indices(ResourceAllocator<std::uint32_t>(resource))
+      , m_slots(ResourceAllocator<Slot>(resource))
+    {}
+
+    template<typename... Args>
+    SlotKey Emplace(Args&&... args)
+    {
+      if (m_freeHead == m_slots.size())
+        m_slots.emplace_back(Slot{0U, m_freeHead + 1U});
+
+      auto const index = m_freeHead;
+      auto &&slot = m_slots[index];
+      m_values.emplace_back(std::forward<Args>(args)...);
+      m_indices.push_back(index);
+      m_freeHead = slot.pos;
+      slot.pos = static_cast<std::uint32_t>(m_values.size() - 1U);
+
+      return SlotKey{index, slot.generation};
+    }
+
+    void Erase(SlotKey key)
+    {
+      auto &&slot = Find(key);
+
+      // move the last element into the gap
+      auto const pos = slot.pos;
+      if (pos + 1U != m_values.size()) {
+        m_values[pos] = std::move(m_values.back());
+        m_indices[pos] = m_indices.back();
+        m_slots[m_indices[pos]].pos = pos;
+      }
+      m_values.pop_back();
+      m_indices.pop_back();
+
+      // invalidate the key and recycle the slot
+      ++slot.generation;
+      slot.pos = m_freeHead;
+      m_freeHead = key.index;
+    }
+
+    T &operator[](SlotKey key)
+    {
+      return m_values[Find(key).pos];
+    }
+
+    iterator begin()
+    {
+      return m_values.begin();
+    }
+
+    iterator end()
+    {
+      return m_values.end();
+    }
+
+    size_t size() const noexcept
+    {
+      return m_values.size();
+    }
+
+    bool empty() const noexcept
+    {
+      return m_values.empty();
+    }
+
+  private:
+    struct Slot
+    {
+      std::uint32_t generation; // incremented on erase to detect stale keys
+      std::uint32_t pos; // position in values if occupied, next free slot index otherwise
+    };
+
+    Slot &Find(SlotKey key)
+    {
+      assert(key.index < m_slots.size());
+      auto &&slot = m_slots[key.index];
+      assert(slot.generation == key.generation);
+      return slot;
+    }
+
+  private:
+    Vector<T> m_values;
+    Vector<std::uint32_t> m_indices; // slot index per value
+    Vector<Slot> m_slots;
+    std::uint32_t m_freeHead = 0U; // index of the first free slot, slots size if none
+  };
+
+#ifdef SWITCHBUFFER_FUTEX
+  /// @brief  wakeup primitive for threads waiting on a condition published by another thread
+  /// @note  notifying is a single atomic load unless some thread is actually waiting,
+  ///        and a single futex wake syscall otherwise
+  /// @tparam  IsProcessShared  whether waiters may be in other processes mapping the notifier
+  template<bool IsProcessShared>
+  class FutexNotifier
+  {
+  public:
+    FutexNotifier()
+      : m_waiters(0U)
+      , m_epoch(0U)
+    {}
+
+    /// block until pred returns true, rechecked after each Notify
+    template<typename Predicate>
+    void Wait(Predicate pred)
+    {
+      (void)WaitUntil(pred, std::chrono::steady_clock::time_point::max());
+    }
+
+    /// @brief  block until pred returns true or the deadline passes
+    /// @return  the last result of pred
+    template<typename Predicate>
+    bool WaitUntil(Predicate pred, std::chrono::steady_clock::time_point deadline)
+    {
+      // announce before checking pred, pairing with Notify checking
+      // for waiters after the condition has been published
+      m_waiters.fetch_add(1U);
+      bool isMet;
+      for (;;) {
+        auto const epoch = m_epoch.load();
+        isMet = pred();
+        if (isMet)
+          break;
+
+        // sleeps only if no Notify happened since loading the epoch
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+          (void)syscall(SYS_futex, Word(), (IsProcessShared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE), epoch, nullptr, nullptr, 0);
+        } else {
+          auto const now = std::chrono::steady_clock::now();
+          if (now >= deadline)
+            break;
+
+          // the timeout is relative and measured against the monotonic clock, like steady_clock
+          auto const remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now).count();
+          timespec timeout;
+          timeout.tv_sec = static_cast<time_t>(remaining / 1000000000);
+          timeout.tv_nsec = static_cast<long>(remaining % 1000000000);
+          (void)syscall(SYS_futex, Word(), (IsProcessShared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE), epoch, &timeout, nullptr, 0);
+        }
+      }
+      m_waiters.fetch_sub(1U);
+      return isMet;
+    }
+
+    /// wake all waiting threads; call after publishing the condition
+    void Notify()
+    {
+      if (m_waiters.load() != 0U) {
+        m_epoch.fetch_add(1U);
+        (void)syscall(SYS_futex, Word(), (IsProcessShared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE), INT_MAX, nullptr, nullptr, 0);
+      }
+    }
+
+  private:
+    std::uint32_t *Word() noexcept
+    {
+      static_assert(sizeof(m_epoch) == sizeof(std::uint32_t), "futex word must be 32 bit");
+      return reinterpret_cast<std::uint32_t *>(&m_epoch);
+    }
+
+  private:
+    std::atomic<size_t> m_waiters;
+    std::atomic<std::uint32_t> m_epoch; // futex word, advanced by every Notify that wakes
+  };
+
+  using Notifier = FutexNotifier<false>;
+#else
+  /// @brief  wakeup primitive for threads waiting on a condition published by another thread
+  /// @note  notifying is a single atomic load unless some thread is actually waiting
+  class Notifier
+  {
+  public:
+    Notifier()
+      : m_waiters(0U)
+    {}
+
+    /// block until pred returns true, rechecked after each Notify
+    template<typename Predicate>
+    void Wait(Predicate pred)
+    {
+      // announce before checking pred, pairing with Notify checking
+      // for waiters after the condition has been published
+      m_waiters.fetch_add(1U);
+      {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv.wait(lock, pred);
+      }
+      m_waiters.fetch_sub(1U);
+    }
+
+    /// @brief  block until pred returns true or the deadline passes
+    /// @return  the last result of pred
+    template<typename Predicate>
+    bool WaitUntil(Predicate pred, std::chrono::steady_clock::time_point deadline)
+    {
+      m_waiters.fetch_add(1U);
+      bool isMet;
+      {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        isMet = m_cv.wait_until(lock, deadline, pred);
+      }
+      m_waiters.fetch_sub(1U);
+      return isMet;
+    }
+
+    /// wake all waiting threads; call after publishing the condition
+    void Notify()
+    {
+      if (m_waiters.load() != 0U) {
+        // serialize with waiters between checking pred and blocking
+        { std::lock_guard<std::mutex> lock(m_mtx); }
+        m_cv.notify_all();
+      }
+    }
+
+  private:
+    std::atomic<size_t> m_waiters;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+  };
+#endif // SWITCHBUFFER_FUTEX
+
+  /// @brief  block until pred returns true or the deadline passes,
+  ///         spinning, yielding, blocking or sleeping as configured
+  /// @return  the last result of pred
+  template<typename WaitNotifier, typename Predicate>
+  bool WaitUntil(WaitStrategy const &waitStrategy, WaitNotifier &notifier, Predicate pred,
+    std::chrono::steady_clock::time_point deadline)
+  {
+    using Clock = std::chrono::steady_clock;
+
+    // spare the untimed waits the clock reads
+    auto const isTimed = (deadline != Clock::time_point::max());
+    for (unsigned int i = 0U;
+         (waitStrategy.mode == WaitStrategy::BusySpin || i < waitStrategy.spinCount); ++i) {
+      if (pred())
+        return true;
+      if (isTimed && Clock::now() >= deadline)
+        return false;
+      CpuRelax();
+    }
+
+    switch (waitStrategy.mode) {
+    case WaitStrategy::SpinYield:
+      while (!pred()) {
+        if (isTimed && Clock::now() >= deadline)
+          return false;
+        std::this_thread::yield();
+      }
+      return true;
+    case WaitStrategy::TimedPark:
+      while (!pred()) {
+        auto const now = Clock::now();
+        if (now >= deadline)
+          return false;
+        std::this_thread::sleep_for(std::min<Clock::duration>(waitStrategy.parkInterval, deadline - now));
+      }
+      return true;
+    default:
+      if (!isTimed) {
+        notifier.Wait(pred);
+        return true;
+      }
+      return notifier.WaitUntil(pred, deadline);
+    }
+  }
+
+  /// block until pred returns true, spinning, yielding, blocking or sleeping as configured
+  template<typename WaitNotifier, typename Predicate>
+  void Wait(WaitStrategy const &waitStrategy, WaitNotifier &notifier, Predicate pred)
+  {
+    (void)WaitUntil(waitStrategy, notifier, pred, std::chrono::steady_clock::time_point::max());
+  }
+
+#ifdef SWITCHBUFFER_EVENTFD
+  /// @brief  readiness of a consumer signalled via an eventfd, guarded by the consumer registry mutex
+  /// @note  plain data to move along with the consumer, closed explicitly
+  class ConsumerReadiness
+  {
+  public:
+    ConsumerReadiness() noexcept
+      : m_fd(-1)
+      , m_isRaised(false)
+    {}
+
+    bool IsOpen() const noexcept
+    {
+      return (m_fd >= 0);
+    }
+
+    int Open()
+    {
+      if (m_fd < 0) {
+        m_fd = ::eventfd(0U, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_fd < 0)
+          throw std::system_error(errno, std::generic_category(), "SwitchBuffer: eventfd");
+      }
+      return m_fd;
+    }
+
+    void Close() noexcept
+    {
+      if (m_fd >= 0) {
+        (void)::close(m_fd);
+        m_fd = -1;
+        m_isRaised = false;
+      }
+    }
+
+    /// make the descriptor readable, with a syscall only if it is not yet
+    void Raise() noexcept
+    {
+      if (!m_isRaised) {
+        std::uint64_t const one = 1U;
+        (void)::write(m_fd, &one, sizeof(one));
+        m_isRaised = true;
+      }
+    }
+
+    /// make the descriptor unreadable, with a syscall only if it is not yet
+    void Clear() noexcept
+    {
+      if (m_isRaised) {
+        std::uint64_t count;
+        (void)::read(m_fd, &count, sizeof(count));
+        m_isRaised = false;
+      }
+    }
+
+  private:
+    int m_fd;
+    bool m_isRaised; // flag whether the eventfd counter is non-zero
+  };
+#else
+  /// no-op stand-in without eventfd
+  class ConsumerReadiness
+  {
+  public:
+    bool IsOpen() const noexcept
+    {
+      return false;
+    }
+
+    void Close() noexcept
+    {}
+
+    void Raise() noexcept
+    {}
+
+    void Clear() noexcept
+    {}
+  };
+#endif // SWITCHBUFFER_EVENTFD
+
+#ifdef SWITCHBUFFER_COROUTINE
+  /// coroutine suspended on an empty ring, guarded by the consumer registry mutex
+  struct Awaiting
+  {
+    std::coroutine_handle<> handle;
+    ResumeFunction resume;
+    void *context;
+
+    explicit operator bool() const noexcept
+    {
+      return static_cast<bool>(handle);
+    }
+
+    void Resume() const
+    {
+      if (resume)
+        resume(handle, context);
+      else
+        handle.resume();
+    }
+  };
+#else
+  /// no-op stand-in without coroutines
+  struct Awaiting
+  {
+    explicit operator bool() const noexcept
+    {
+      return false;
+    }
+
+    void Resume() const noexcept
+    {}
+  };
+#endif // SWITCHBUFFER_COROUTINE
+
+  inline void Accumulate(ConsumerStatistics &sum, ConsumerStatistics const &stats) noexcept
+  {
+    sum.consumed += stats.consumed;
+    sum.overwritten += stats.overwritten;
+    sum.skipped += stats.skipped;
+    sum.blocked += stats.blocked;
+    sum.blockedTime += stats.blockedTime;
+  }
+
+#ifdef SWITCHBUFFER_STATISTICS
+  /// statistics of a consumer, guarded by the consumer registry mutex
+  class ConsumerCounters
+  {
+  public:
+    ConsumerCounters()
+      : m_stats()
+    {}
+
+    void Consume(std::uint64_t count) noexcept
+    {
+      m_stats.consumed += count;
+    }
+
+    void Overwrite(std::uint64_t count) noexcept
+    {
+      m_stats.overwritten += count;
+    }
+
+    void Skip(std::uint64_t count) noexcept
+    {
+      m_stats.skipped += count;
+    }
+
+    void BeginBlock()
+    {
+      ++m_stats.blocked;
+      m_blockedSince = std::chrono::steady_clock::now();
+    }
+
+    void EndBlock()
+    {
+      m_stats.blockedTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - m_blockedSince);
+    }
+
+    ConsumerStatistics Get() const noexcept
+    {
+      return m_stats;
+    }
+
+  private:
+    ConsumerStatistics m_stats;
+    std::chrono::steady_clock::time_point m_blockedSince;
+  };
+#else
+  /// statistics of a consumer, compiled out
+  class ConsumerCounters
+  {
+  public:
+    void Consume(std::uint64_t) noexcept
+    {}
+
+    void Overwrite(std::uint64_t) noexcept
+    {}
+
+    void Skip(std::uint64_t) noexcept
+    {}
+
+    void BeginBlock() noexcept
+    {}
+
+    void EndBlock() noexcept
+    {}
+
+    ConsumerStatistics Get() const noexcept
+    {
+      return ConsumerStatistics();
+    }
+  };
+#endif // SWITCHBUFFER_STATISTICS
+
+  /// ring of slots with compile-time size, stored inline
+  template<typename Slot, size_t RingSize>
+  struct Ring
+  {
+    static_assert(RingSize > 1U, "SwitchBuffer: ring buffer size must be larger than 1");
+
+    std::array<Slot, RingSize> slots;
+
+    explicit Ring(SwitchBufferMemoryResource *)
+    {}
+
+    static constexpr size_t size() noexcept
+    {
+      return RingSize;
+    }
+
+    static constexpr size_t Index(std::uint64_t seq) noexcept
+    {
+      return static_cast<size_t>(seq % RingSize);
+    }
+
+    Slot &operator[](size_t pos)
+    {
+      return slots[pos];
+    }
+  };
+
+  /// ring of slots with runtime size
+  template<typename Slot>
+  struct Ring<Slot, 0U>
+  {
+    size_t const m_size;
+    size_t const m_mask; // size - 1 if indexing by bitmask, 0 otherwise
+    AlignedArray<Slot> slots;
+
+    Ring(SwitchBufferMemoryResource *resource, size_t ringBufferSize, bool powerOfTwo)
+      : m_size(ringBufferSize)
+      , m_mask(powerOfTwo ? ringBufferSize - 1U : 0U)
+      , slots(resource, Validate(ringBufferSize, powerOfTwo))
+    {}
+
+    size_t size() const noexcept
+    {
+      return m_size;
+    }
+
+    size_t Index(std::uint64_t seq) const noexcept
+    {
+      // the branch is constant per ring and thus cheaper than the division it avoids
+      return (m_mask ? static_cast<size_t>(seq & m_mask) : static_cast<size_t>(seq % m_size));
+    }
+
+    Slot &operator[](size_t pos)
+    {
+      return slots[pos];
+    }
+
+    static size_t Validate(size_t ringBufferSize, bool powerOfTwo)
+    {
+      if (ringBufferSize <= 1U)
+        throw std::logic_error("SwitchBuffer: ring buffer size must be larger than 1");
+      if (powerOfTwo && (ringBufferSize & (ringBufferSize - 1U)))
+        throw std::logic_error("SwitchBuffer: ring buffer size must be a power of two");
+      return ringBufferSize;
+    }
+  };
+
+  /// cells referenced by address, for a ring within a single process
+  template<typename Cell>
+  struct CellPointers
+  {
+    using Ref = Cell *;
+
+    static constexpr Ref none = nullptr; // reference terminating a list
+
+    Cell &operator[](Ref ref) const noexcept
+    {
+      return *ref;
+    }
+  };
+
+  template<typename Cell>
+  constexpr typename CellPointers<Cell>::Ref CellPointers<Cell>::none;
+
+  /// cells referenced by index into an array, for a ring in shared memory mapped at any address
+  template<typename Cell>
+  struct CellIndices
+  {
+    using Ref = std::uint32_t;
+
+    static constexpr Ref none = 0xFFFFFFFFU; // reference terminating a list
+
+    Cell *cells;
+
+    Cell &operator[](Ref ref) const noexcept
+    {
+      return cells[ref];
+    }
+  };
+
+  template<typename Cell>
+  constexpr typename CellIndices<Cell>::Ref CellIndices<Cell>::none;
+
+  /// @brief  lock-free protocol of the producers overwriting ring slots
+  ///         and the consumers pinning the buffers in them
+  /// @note  a slot holds the atomic seq, the sequence number + 1 of its published buffer
+  ///        or 0 while in production, and the atomic cell, referencing the storage of
+  ///        the buffer; a cell holds the atomic pins, the number of consumers reading
+  ///        it plus the detached flag, the free list link next and isConstructed.
+  ///        A cell pinned when its slot is overwritten is replaced by a spare and
+  ///        returned to the free list by the last consumer to unpin it.
+  template<typename Cells>
+  struct CellProtocol
+  {
+    using Ref = typename Cells::Ref;
+    using Sequence = std::uint64_t;
+
+    static constexpr std::uint32_t detached = 0x80000000U; // flag set when replaced in its slot while pinned
+
+    Cells cells;
+    std::atomic<Ref> *freed; // free list of detached cells no longer pinned,
+                             // pushed by the consumers and taken by the producers
+
+    /// sequence number of the oldest buffer that may not be overwritten yet
+    static Sequence Oldest(Sequence avail, size_t ringSize) noexcept
+    {
+      return (avail >= ringSize ? avail - ringSize + 1U : 0U);
+    }
+
+    /// @brief  hand out the slot of a sequence number to a producer
+    /// @param[in]  spare  callable returning a detached cell to swap in if the slot's is pinned
+    template<typename Ring, typename MakeSpare>
+    Ref Claim(Ring &ring, Sequence seq, MakeSpare spare) const
+    {
+      auto &&slot = ring[ring.Index(seq)];
+
+      // invalidate the slot for concurrent consumers before checking its cell for pins
+      slot.seq.store(0U);
+
+      auto ref = slot.cell.load(std::memory_order_relaxed);
+      if (cells[ref].pins.fetch_or(detached) == 0U) {
+        // not in consumption; reuse in place
+        cells[ref].pins.store(0U, std::memory_order_relaxed);
+      } else {
+        // save buffer that is currently consumed by swapping in a spare;
+        // the last consumer to unpin it returns it to the free list
+        ref = spare();
+        slot.cell.store(ref, std::memory_order_release);
+      }
+      return ref;
+    }
+
+    /// @brief  pin the next consumable buffer, if any
+    /// @param[in,out]  next  sequence number of the next buffer to consume
+    template<typename Ring, typename Counters>
+    bool Acquire(Ring &ring, std::atomic<Sequence> const &published,
+      Sequence &next, bool skipToMostRecent, Ref &pinned, Counters &counters) const
+    {
+      auto avail = published.load(std::memory_order_acquire);
+      auto seq = next;
+      while (seq < avail) {
+        // skip whatever the producers have overwritten already,
+        // and the intermediates if asked to
+        auto const oldest = std::max(seq, Oldest(avail, ring.size()));
+        auto const target = (skipToMostRecent ? std::max(oldest, avail - 1U) : oldest);
+        counters.Overwrite(oldest - seq);
+        counters.Skip(target - oldest);
+        seq = target;
+
+        if (Pin(ring, seq, pinned)) {
+          counters.Consume(1U);
+          next = seq + 1U;
+          return true;
+        }
+
+        // lapped by a producer meanwhile
+        counters.Overwrite(1U);
+        avail = published.load(std::memory_order_acquire);
+        ++seq;
+      }
+      next = seq;
+      return false;
+    }
+
+    /// @return  false if the slot does not hold the buffer of the sequence number (anymore)
+    template<typename Ring>
+    bool Pin(Ring &ring, Sequence seq, Ref &pinned) const
+    {
+      auto &&slot = ring[ring.Index(seq)];
+      if (slot.seq.load(std::memory_order_acquire) != seq + 1U)
+        return false;
+
+      auto const ref = slot.cell.load(std::memory_order_acquire);
+      auto &&cell = cells[ref];
+      auto pins = cell.pins.load(std::memory_order_relaxed);
+      do {
+        if (pins & detached)
+          return false;
+      } while (!cell.pins.compare_exchange_weak(pins, pins + 1U));
+
+      // pair with the producer invalidating the slot before checking for pins;
+      // a buffer that failed to construct is published but never handed out
+      if (slot.seq.load() != seq + 1U || !cell.isConstructed) {
+        Unpin(ref);
+        return false;
+      }
+
+      pinned = ref;
+      return true;
+    }
+
+    void Unpin(Ref ref) const
+    {
+      if (cells[ref].pins.fetch_sub(1U, std::memory_order_acq_rel) == (detached | 1U))
+        Free(ref);
+    }
+
+    /// push a cell onto the free list; popping takes the whole list, so it is free of ABA
+    void Free(Ref ref) const
+    {
+      auto head = freed->load(std::memory_order_relaxed);
+      do {
+        cells[ref].next = head;
+      } while (!freed->compare_exchange_weak(head, ref,
+        std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /// @brief  take a detached cell from a producer's cached spares, refilled from the free list
+    /// @return  Cells::none if both are empty
+    Ref TakeSpare(Ref &spares) const
+    {
+      if (spares == Cells::none)
+        spares = freed->exchange(Cells::none, std::memory_order_acquire);
+      if (spares == Cells::none)
+        return Cells::none;
+
+      auto const ref = spares;
+      spares = cells[ref].next;
+      cells[ref].pins.store(0U, std::memory_order_relaxed);
+      return ref;
+    }
+
+    /// hand a producer's cached spares back to the free list
+    void ReturnSpares(Ref &spares) const
+    {
+      while (spares != Cells::none) {
+        auto const ref = spares;
+        spares = cells[ref].next;
+        Free(ref);
+      }
+    }
+  };
+
+  template<typename Cells>
+  constexpr std::uint32_t CellProtocol<Cells>::detached;
+
+  template<typename Buffer, size_t RingSize>
+  struct SwitchBufferImpl
+  {
+    using Sequence = std::uint64_t;
+
+    /// storage of a single buffer, referenced from one ring slot at a time
+    struct Cell
+    {
+      std::atomic<std::uint32_t> pins; // number of consumers reading the buffer plus detached flag
+      Cell *next; // link within the free list of detached cells
+      bool isConstructed; // flag whether storage holds a buffer
+      alignas(Buffer) unsigned char storage[sizeof(Buffer)]; // buffer, constructed on first use
+
+      Cell(std::uint32_t pins)
+        : pins(pins)
+        , next(nullptr)
+        , isConstructed(false)
+      {}
+
+      Cell(Cell const &) = delete;
+
+      ~Cell()
+      {
+        Destroy();
+      }
+
+      Cell &operator=(Cell const &) = delete;
+
+      Buffer &Get() noexcept
+      {
+        return *reinterpret_cast<Buffer *>(storage);
+      }
+
+      /// default-construct the buffer unless it holds a previous content
+      Buffer &Construct()
+      {
+        if (!isConstructed) {
+          new (storage) Buffer();
+          isConstructed = true;
+        }
+        return Get();
+      }
+
+      /// replace the previous content, if any, with a buffer constructed from args
+      template<typename... Args>
+      Buffer &Emplace(Args&&... args)
+      {
+        Destroy();
+        new (storage) Buffer(std::forward<Args>(args)...);
+        isConstructed = true;
+        return Get();
+      }
+
+      void Destroy() noexcept
+      {
+        if (isConstructed) {
+          Get().~Buffer();
+          isConstructed = false;
+        }
+      }
+    };
+    using Spares = Vector<AlignedArray<Cell>>;
+    using Protocol = CellProtocol<CellPointers<Cell>>;
+
+    /// ring position with inline storage for its buffer, one cache line apart from its neighbours
+    struct alignas(cacheLineSize) Slot
+    {
+      std::atomic<Sequence> seq; // sequence number + 1 of the published buffer, 0 while in production
+      std::atomic<Cell *> cell; // storage of the buffer currently occupying the slot
+      Cell home; // inline storage, replaced by a spare while pinned at overwrite
+
+      Slot()
+        : seq(0U)
+        , cell(&home)
+        , home(0U)
+      {}
+
+      Slot(Slot const &) = delete;
+      Slot &operator=(Slot const &) = delete;
+    };
+    using Ring = detail::Ring<Slot, RingSize>;
+
+    /// producer state, apart from that of the other producers and the shared state
+    struct alignas(interfaceAlignment) Producer
+    {
+      Sequence seq; // sequence number of the first in-production buffer
+      size_t claimed; // number of slots from seq on handed out to the producer
+      Cell *spares; // detached cells taken over from the consumers
+      Vector<Buffer *> batch; // buffers of the slots claimed by a batch
+      Vector<Awaiting> resumed; // coroutines to resume once the consumer registry mutex is released
+
+      explicit Producer(SwitchBufferMemoryResource *resource)
+        : seq(0U)
+        , claimed(0U)
+        , spares(nullptr)
+        , batch(ResourceAllocator<Buffer *>(resource))
+        , resumed(ResourceAllocator<Awaiting>(resource))
+      {}
+    };
+
+    /// consumer state, one cache line apart from its neighbours in the registry
+    struct alignas(cacheLineSize) Consumer
+    {
+      Sequence next; // sequence number of the next buffer to consume
+      Sequence sequence; // sequence number of the buffer handed out last
+      bool isReliable; // flag whether the producers wait rather than overwrite buffers not yet consumed
+      size_t rank; // position within the heap of reliable consumers, if reliable
+      Cell *pinned; // in-consumption buffer, protected from being overwritten
+      Vector<Cell *> batch; // in-consumption buffers of a batch, protected from being overwritten
+      Vector<Buffer const *> batchBuffers; // buffers of the cells in batch
+      Vector<Sequence> batchSequences; // sequence numbers of the buffers in batch
+      optional<std::promise<Buffer const &>> promise; // promise to fulfill after empty ring
+      Awaiting awaiting; // coroutine to resume after empty ring
+      ConsumerCounters counters;
+      ConsumerReadiness readiness; // file descriptor signalling available buffers, if requested
+
+      Consumer(SwitchBufferMemoryResource *resource, bool isReliable)
+        : next(0U)
+        , sequence(0U)
+        , isReliable(isReliable)
+        , rank(0U)
+        , pinned(nullptr)
+        , batch(ResourceAllocator<Cell *>(resource))
+        , batchBuffers(ResourceAllocator<Buffer const *>(resource))
+        , batchSequences(ResourceAllocator<Sequence>(resource))
+      {}
+
+      Consumer(const Consumer &other) = delete;
+      Consumer(Consumer &&other) noexcept = default;
+      ~Consumer() = default;
+
+      Consumer &operator=(const Consumer &other) = delete;
+      Consumer &operator=(Consumer &&other) noexcept = default;
+    };
+    using Consumers = SlotMap<Consumer>;
+
+    /// consumer receiving each published buffer via callback
+    struct Callback
+    {
+      std::function<void(Buffer const &)> function;
+      std::chrono::nanoseconds budget; // duration of an inline invocation that demotes the callback
+      Sequence next; // sequence number of the next buffer to deliver
+      std::atomic<bool> isAsync; // flag whether demoted to delivery by thread
+      std::thread thread; // delivery thread once demoted
+      std::mutex mtx; // guards isPending and isStopping
+      std::condition_variable cv;
+      bool isPending; // flag whether buffers were published since the delivery thread last looked
+      bool isStopping; // flag whether the delivery thread is to exit
+
+      Callback(std::function<void(Buffer const &)> function, std::chrono::nanoseconds budget)
+        : function(std::move(function))
+        , budget(budget)
+        , next(0U)
+        , isAsync(false)
+        , isPending(false)
+        , isStopping(false)
+      {}
+
+      Callback(Callback const &) = delete;
+      Callback &operator=(Callback const &) = delete;
+
+      /// have the delivery thread look for new buffers
+      void Wake()
+      {
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          isPending = true;
+        }
+        cv.notify_one();
+      }
+    };
+
+    // configuration, written on construction only
+    SwitchBufferMemoryResource *const resource; // source of the ring and all other shared state
+    bool const isMultiProducer; // flag whether slots are claimed by atomic ticket
+    Ring ring;
+
+    // hot atomics, each on a cache line of its own as they are written by different parties
+    alignas(cacheLineSize) std::atomic<Sequence> published; // number of published buffers, written by the producers
+    alignas(cacheLineSize) std::atomic<Sequence> tickets; // next sequence number to claim in multi-producer mode
+    alignas(cacheLineSize) std::atomic<Sequence> limit; // end of the sequence numbers to claim without lapping
+                                                        // a reliable consumer, written by the reliable consumers
+    alignas(cacheLineSize) std::atomic<Cell *> freed; // free list of detached cells no longer pinned,
+                                                      // pushed by the consumers and taken by the producers
+    Protocol const protocol; // slot and cell protocol over freed
+
+    // rarely written, yet read by the producers on every publication
+    alignas(cacheLineSize) std::atomic<size_t> waiting; // number of consumers with an open promise or suspended coroutine
+    std::atomic<size_t> polling; // number of consumers with a file descriptor
+    std::atomic<size_t> calling; // number of callback consumers
+    std::atomic<size_t> producers; // number of open producers
+    std::atomic<bool> isClosed; // flag whether producer has shut down
+
+    alignas(cacheLineSize) Notifier notifier; // wakes consumers blocked without a promise
+    alignas(cacheLineSize) Notifier backpressure; // wakes producers blocked by a reliable consumer
+
+    // consumer registry, written by the consumers under its mutex
+    alignas(cacheLineSize) std::mutex mtx; // guards consumers, promised, polled, reliable and closed
+    Consumers consumers;
+    Vector<SlotKey> promised; // consumers with an open promise or suspended coroutine
+    Vector<SlotKey> polled; // consumers with a file descriptor
+    Vector<SlotKey> reliable; // consumers not to be lapped, as min-heap by next buffer to consume
+    ConsumerStatistics closed; // accumulated statistics of the closed consumers
+
+    alignas(cacheLineSize) std::mutex sparesMtx; // guards spares, apart from the consumers
+    Spares spares; // owns the cells beyond the inline ones of the ring slots, allocated on demand
+
+    alignas(cacheLineSize) std::mutex callbacksMtx; // guards callbacks and their inline invocation, apart from the consumers
+    Vector<Callback *> callbacks; // callback consumers, owned by their interfaces
+
+    template<typename... Args>
+    SwitchBufferImpl(SwitchBufferMemoryResource *resource, ProducerMode producerMode, Args&&... args)
+      : resource(resource)
+      , isMultiProducer(producerMode == ProducerMode::Multi)
+      , ring(resource, std::forward<Args>(args)...)
+      , published(0U)
+      , tickets(0U)
+      , limit(std::numeric_limits<Sequence>::max())
+      , freed(nullptr)
+      , protocol{CellPointers<Cell>(), &freed}
+      , waiting(0U)
+      , polling(0U)
+      , calling(0U)
+      , producers(0U)
+      , isClosed(false)
+      , consumers(resource)
+      , promised(ResourceAllocator<SlotKey>(resource))
+      , polled(ResourceAllocator<SlotKey>(resource))
+      , reliable(ResourceAllocator<SlotKey>(resource))
+      , closed()
+      , spares(ResourceAllocator<AlignedArray<Cell>>(resource))
+      , callbacks(ResourceAllocator<Callback *>(resource))
+    {}
+
+    SwitchBufferImpl(const SwitchBufferImpl &) = delete;
+    SwitchBufferImpl(SwitchBufferImpl &&) = delete;
+
+    /// create in a single cache line aligned allocation from the memory resource, if any
+    template<typename... Args>
+    static std::shared_ptr<SwitchBufferImpl> Create(SwitchBufferMemoryResource *resource, Args&&... args)
+    {
+      if (!resource)
+        resource = DefaultMemoryResource();
+
+      return std::allocate_shared<SwitchBufferImpl>(
+        ResourceAllocator<SwitchBufferImpl>(resource, cacheLineSize),
+        resource, std::forward<Args>(args)...);
+    }
+
+    ~SwitchBufferImpl()
+    {
+      assert(consumers.empty());
+    }
+
+    SwitchBufferImpl &operator=(const SwitchBufferImpl &) = delete;
+    SwitchBufferImpl &operator=(SwitchBufferImpl &&) = delete;
+
+    SlotKey CreateConsumer(bool isReliable)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      // start with the next buffer to be published rather than whatever is left in the ring
+      auto const key = consumers.Emplace(resource, isReliable);
+      consumers[key].next = published.load();
+      if (isReliable) {
+        consumers[key].rank = reliable.size();
+        reliable.push_back(key);
+        SiftUp(reliable.size() - 1U);
+        Relieve();
+      }
+      return key;
+    }
+
+    Producer CreateProducer()
+    {
+      producers.fetch_add(1U);
+      return Producer(resource);
+    }
+
+    void CloseProducer(Producer &producer)
+    {
+      if (isMultiProducer) {
+        // later claims of the other producers are published only after ours, so commit them
+        // empty like a failed Emplace; as in single-producer mode, the consumers never see
+        // the buffers taken but not followed by another switch
+        for (size_t i = 0U; i < producer.claimed; ++i)
+          ring[ring.Index(producer.seq + i)].cell.load(std::memory_order_relaxed)->Destroy();
+        Publish(producer);
+      }
+
+      // hand the cached spares back for the other producers to use
+      protocol.ReturnSpares(producer.spares);
+
+      if (producers.fetch_sub(1U) != 1U)
+        return;
+
+      isClosed.store(true);
+
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        // if there are open promises, break them; resume suspended coroutines empty-handed
+        for (auto &&key : promised) {
+          auto &&consumer = consumers[key];
+          consumer.promise.reset();
+          if (consumer.awaiting) {
+            producer.resumed.push_back(consumer.awaiting);
+            consumer.awaiting = Awaiting();
+          }
+          consumer.counters.EndBlock();
+        }
+        promised.clear();
+        waiting.store(0U);
+
+        for (auto &&key : polled)
+          Signal(consumers[key]);
+      }
+
+      notifier.Notify();
+      Resume(producer);
+    }
+
+    void CloseConsumer(SlotKey key)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      auto &&consumer = consumers[key];
+      if (consumer.promise || consumer.awaiting) {
+        // a coroutine suspended on its own consumer is destroyed along with it, not resumed
+        consumer.counters.EndBlock();
+        Unpromise(key);
+      }
+      if (consumer.readiness.IsOpen()) {
+        Erase(polled, key);
+        polling.fetch_sub(1U);
+        consumer.readiness.Close();
+      }
+      Unpin(consumer);
+      Accumulate(closed, consumer.counters.Get());
+      if (consumer.isReliable) {
+        // replace by the last entry of the heap, then move that to its place
+        auto const pos = consumer.rank;
+        SwapReliable(pos, reliable.size() - 1U);
+        reliable.pop_back();
+        if (pos < reliable.size()) {
+          SiftUp(pos);
+          SiftDown(pos);
+        }
+        Relieve();
+      }
+      consumers.Erase(key);
+    }
+
+    void AddCallback(Callback &callback)
+    {
+      std::lock_guard<std::mutex> lock(callbacksMtx);
+
+      callback.next = published.load();
+      callbacks.push_back(&callback);
+      calling.fetch_add(1U);
+    }
+
+    void RemoveCallback(Callback &callback)
+    {
+      {
+        // wait for an inline invocation to return
+        std::lock_guard<std::mutex> lock(callbacksMtx);
+
+        auto const it = std::find(std::begin(callbacks), std::end(callbacks), &callback);
+        assert(it != std::end(callbacks));
+        *it = callbacks.back();
+        callbacks.pop_back();
+        calling.fetch_sub(1U);
+      }
+
+      if (callback.thread.joinable()) {
+        {
+          std::lock_guard<std::mutex> lock(callback.mtx);
+          callback.isStopping = true;
+        }
+        callback.cv.notify_one();
+        callback.thread.join();
+      }
+    }
+
+    ConsumerStatistics GetStatistics(SlotKey key)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      return consumers[key].counters.Get();
+    }
+
+    ConsumerStatistics GetStatistics()
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      auto sum = closed;
+      for (auto &&consumer : consumers)
+        Accumulate(sum, consumer.counters.Get());
+      return sum;
+    }
+
+    Buffer &SwitchProducer(Producer &producer)
+    {
+      return Next(producer).Construct();
+    }
+
+    template<typename... Args>
+    Buffer &EmplaceProducer(Producer &producer, Args&&... args)
+    {
+      return Next(producer).Emplace(std::forward<Args>(args)...);
+    }
+
+    template<typename ResetFunction>
+    Buffer &ResetProducer(Producer &producer, ResetFunction &&reset)
+    {
+      auto &&cell = Next(producer);
+      if (!cell.isConstructed)
+        return cell.Construct();
+
+      reset(cell.Get());
+      return cell.Get();
+    }
+
+    /// publish the previous buffers of a producer and claim the slot of the next one
+    Cell &Next(Producer &producer)
+    {
+      Publish(producer);
+
+      (void)Reserve(producer, 1U, false);
+      return *Claim(producer, producer.seq);
+    }
+
+    /// like SwitchProducer, failing rather than waiting for a reliable consumer
+    Buffer *TrySwitchProducer(Producer &producer)
+    {
+      Publish(producer);
+
+      if (!Reserve(producer, 1U, true))
+        return nullptr;
+      return &Claim(producer, producer.seq)->Construct();
     }
 
-    void reset() noexcept
+    Buffer *const *SwitchProducerBatch(Producer &producer, size_t count)
     {
-      m_ptr.reset();
+      if (count == 0U || count >= ring.size())
+        throw std::logic_error("SwitchBuffer: batch size must be between 1 and ring buffer size - 1");
+
+      Publish(producer);
+
+      // reserve for the largest batch possible once
+      producer.batch.clear();
+      producer.batch.reserve(ring.size());
+      (void)Reserve(producer, count, false);
+      for (size_t i = 0U; i < count; ++i)
+        producer.batch.push_back(&Claim(producer, producer.seq + i)->Construct());
+
+      return producer.batch.data();
     }
 
-    T *operator->()
+    /// @brief  determine the sequence numbers of the next count buffers of a producer,
+    ///         waiting for the reliable consumers to make room unless trying only
+    /// @return  false if tried and the buffers would lap a reliable consumer
+    bool Reserve(Producer &producer, size_t count, bool isTry)
     {
-      return m_ptr.get();
+      // a single producer continues right after its previously published buffers
+      if (isMultiProducer) {
+        if (!isTry) {
+          producer.seq = tickets.fetch_add(count);
+        } else {
+          // claim a ticket only if it is admitted, as it cannot be handed back
+          auto seq = tickets.load();
+          do {
+            if (!Admit(seq + count, true))
+              return false;
+          } while (!tickets.compare_exchange_weak(seq, seq + count));
+          producer.seq = seq;
+
+          // admitted already; checking again could fail on a reliable consumer registered meanwhile
+          // and leave the ticket uncommitted for good, while Claim keeps it from lapping anyway
+          producer.claimed = count;
+          return true;
+        }
+      }
+
+      if (!Admit(producer.seq + count, isTry))
+        return false;
+      producer.claimed = count;
+      return true;
     }
 
-    operator bool() const noexcept
+    /// @brief  check the sequence numbers up to end for overwriting buffers a reliable consumer has yet to consume,
+    ///         waiting for it to move on unless trying only
+    /// @return  false if tried and the buffers would lap a reliable consumer
+    bool Admit(Sequence end, bool isTry)
     {
-      return !!m_ptr;
+      // without reliable consumers, the limit is never written and stays in the producer's cache;
+      // sequentially consistent to pair with Relieve checking for waiters after updating the limit
+      auto const isAdmitted = [&]() -> bool {
+        return (end <= limit.load());
+      };
+      if (isAdmitted())
+        return true;
+      if (isTry)
+        return false;
+
+      // the reliable consumer is busy with a buffer; spin briefly, then block
+      Wait(WaitStrategy(WaitStrategy::SpinPark, 64U), backpressure, isAdmitted);
+      return true;
     }
 
-  private:
-    std::unique_ptr<T> m_ptr;
-  };
-#endif // __cplusplus >= 201703L
+    /// publish the in-production buffers of a producer, if any
+    void Publish(Producer &producer)
+    {
+      if (producer.claimed == 0U)
+        return;
 
-  template<typename Buffer>
-  struct SwitchBufferImpl
-  {
-    using Ring = std::vector<std::unique_ptr<Buffer>>;
+      if (!isMultiProducer) {
+        for (size_t i = 0U; i < producer.claimed; ++i) {
+          auto const seq = producer.seq + i;
+          ring[ring.Index(seq)].seq.store(seq + 1U, std::memory_order_release);
+        }
+        producer.seq += producer.claimed;
+        producer.claimed = 0U;
+        published.store(producer.seq);
+      } else {
+        // commit the slots, to be published by whichever producer gets to publish their predecessors
+        for (size_t i = 0U; i < producer.claimed; ++i) {
+          auto const seq = producer.seq + i;
+          ring[ring.Index(seq)].seq.store(seq + 1U);
+        }
+        producer.claimed = 0U;
+
+        if (!Advance())
+          return;
+      }
+
+      // notify consumers that wait for something to be produced
+      if (waiting.load() != 0U || polling.load() != 0U)
+        Fulfill(producer);
+      notifier.Notify();
+      Resume(producer);
+      if (calling.load() != 0U)
+        Call();
+    }
 
-    class RingIterator
-      : public std::iterator<std::input_iterator_tag, typename Ring::value_type>
+    /// @brief  advance the number of published buffers over all consecutively committed slots
+    /// @return  false if a predecessor is still in production and its producer is to publish instead
+    bool Advance()
     {
-    public:
-      RingIterator(Ring *ring)
-        : m_ring(ring)
-        , m_pos(ring->size()) // initialize with invalid position index
-      {}
+      auto avail = published.load();
+      for (;;) {
+        // pair with the other producers committing before trying to advance
+        auto next = avail;
+        while (ring[ring.Index(next)].seq.load() == next + 1U)
+          ++next;
 
-      RingIterator &operator++()
-      {
-        ++m_pos;
-        m_pos %= m_ring->size();
-        return *this;
+        if (next == avail)
+          return false;
+        if (published.compare_exchange_weak(avail, next))
+          return true;
       }
+    }
 
-      typename Ring::reference operator*()
-      {
-        assert(*this);
-        return (*m_ring)[m_pos];
+    /// hand out the slot of a sequence number to a producer
+    Cell *Claim(Producer &producer, Sequence seq)
+    {
+      if (isMultiProducer) {
+        // wait for the buffer of the previous lap to be published, as publishing
+        // advances over committed slots only and must not find this one claimed again
+        for (unsigned int i = 0U; published.load(std::memory_order_acquire) + ring.size() <= seq; ++i) {
+          // the producer of the previous lap may well be descheduled
+          if (i < 64U)
+            CpuRelax();
+          else
+            std::this_thread::yield();
+        }
       }
 
-      bool operator==(RingIterator const &other) const
-      {
-        assert(m_ring == other.m_ring);
-        return (m_pos == other.m_pos);
-      }
+      return protocol.Claim(ring, seq, [&]() -> Cell * {
+        return Spare(producer);
+      });
+    }
 
-      // check for valid position index
-      operator bool() const
-      {
-        return (m_pos < m_ring->size());
+    std::future<Buffer const &> SwitchConsumer(
+      SlotKey key, bool skipToMostRecent)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      auto &&consumer = Restart(key);
+      std::future<Buffer const &> future;
+      if (Acquire(consumer, skipToMostRecent)) {
+        // return buffer immediately
+        std::promise<Buffer const &> p(std::allocator_arg, ResourceAllocator<char>(resource));
+        p.set_value(consumer.pinned->Get());
+        future = p.get_future();
+      } else if (isClosed.load()) {
+        // create a promise to be broken immediately
+        future = std::promise<Buffer const &>(std::allocator_arg, ResourceAllocator<char>(resource)).get_future();
+      } else {
+        future = Promise(key, consumer);
       }
 
-    private:
-      Ring *m_ring;
-      typename Ring::size_type m_pos;
-    };
+      Signal(consumer);
+      return future;
+    }
 
-    struct Producer
+    /// @return  sequence number of the buffer last acquired by a consumer
+    Sequence GetSequence(SlotKey key)
     {
-      RingIterator curr; // points to the most recently produced buffer, initialized to invalid
-      RingIterator next; // points to the in-production buffer, initialized to invalid
-      RingIterator olde; // points to the oldest produced buffer, initialized to invalid
-      bool isClosed; // flag whether producer has shut down
+      std::lock_guard<std::mutex> lock(mtx);
+      return consumers[key].sequence;
+    }
 
-      Producer(Ring *ring)
-        : curr(ring)
-        , next(ring)
-        , olde(ring)
-        , isClosed(false)
-      {}
-    };
+    SwitchStatus SwitchConsumerTry(SlotKey key, bool skipToMostRecent,
+      Buffer const *&buffer, Sequence &sequence)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      // leave the previous buffer and an open promise alone on an empty ring
+      if (published.load() <= consumers[key].next && !isClosed.load())
+        return SwitchStatus::Empty;
+
+      auto &&consumer = Restart(key);
+      auto const acquired = Acquire(consumer, skipToMostRecent);
+      Signal(consumer);
+      if (!acquired)
+        return (isClosed.load() ? SwitchStatus::Closed : SwitchStatus::Empty);
+
+      buffer = &consumer.pinned->Get();
+      sequence = consumer.sequence;
+      return SwitchStatus::Ready;
+    }
 
-    struct Consumer
+    SwitchStatus SwitchConsumerWait(SlotKey key, bool skipToMostRecent, WaitStrategy const &waitStrategy,
+      std::chrono::steady_clock::time_point deadline, Buffer const *&buffer, Sequence &sequence)
     {
-      SwitchBufferConsumer<Buffer> const *parent; // parent address used as ID
-      RingIterator pos; // points to the in-consumption buffer, initialized to invalid
-      bool isFull; // flag whether ring is full of consumable slots
-      bool isEmpty; // flag whether ring is empty of consumable slots
-      std::unique_ptr<Buffer> sanctuary; // storage to save in-consumption buffer before being overwritten
-      optional<std::promise<Buffer const &>> promise; // promise to fulfill after empty ring
+      auto const acquire = [&](Consumer &consumer) -> bool {
+        auto const acquired = Acquire(consumer, skipToMostRecent);
 
-      Consumer(SwitchBufferConsumer<Buffer> const *parent, Ring *ring)
-        : parent(parent)
-        , pos(ring)
-        , isFull(false)
-        , isEmpty(true)
-        , sanctuary(new Buffer)
-      {}
+        // like a fulfilled promise, continue with the most recent buffer after waiting
+        skipToMostRecent = !consumer.isReliable;
+        return acquired;
+      };
 
-      Consumer(const Consumer &other) = delete;
-      Consumer(Consumer &&other) noexcept = default;
-      ~Consumer() = default;
+      std::unique_lock<std::mutex> lock(mtx);
+      auto const status = AcquireWait(lock, key, waitStrategy, deadline, acquire);
+      if (status == SwitchStatus::Ready) {
+        buffer = &consumers[key].pinned->Get();
+        sequence = consumers[key].sequence;
+      }
+      return status;
+    }
 
-      Consumer &operator=(const Consumer &other) = delete;
-      Consumer &operator=(Consumer &&other) noexcept = default;
+    /// @return  false if the producer has shut down and all buffers are consumed
+    bool SwitchConsumerBatch(SlotKey key, WaitStrategy const &waitStrategy,
+      Buffer const *const *&buffers, Sequence const *&sequences, size_t &count)
+    {
+      auto const acquire = [&](Consumer &consumer) -> bool {
+        return AcquireBatch(consumer);
+      };
 
-      // for use with std::find
-      bool operator==(SwitchBufferConsumer<Buffer> const *otherParent) const
-      {
-        return (parent == otherParent);
+      std::unique_lock<std::mutex> lock(mtx);
+      auto const status = AcquireWait(lock, key, waitStrategy,
+        std::chrono::steady_clock::time_point::max(), acquire);
+
+      auto &&consumer = consumers[key];
+      buffers = consumer.batchBuffers.data();
+      sequences = consumer.batchSequences.data();
+      count = consumer.batchBuffers.size();
+      return (status == SwitchStatus::Ready);
+    }
+
+    /// @brief  release the previous buffers of a consumer and acquire new ones,
+    ///         waiting on an empty ring until the deadline
+    /// @return  Empty if the deadline passed, Closed if the producer has shut down and all buffers are consumed
+    template<typename AcquireFunction>
+    SwitchStatus AcquireWait(std::unique_lock<std::mutex> &lock, SlotKey key,
+      WaitStrategy const &waitStrategy, std::chrono::steady_clock::time_point deadline,
+      AcquireFunction acquire)
+    {
+      (void)Restart(key);
+      while (!acquire(consumers[key])) {
+        if (isClosed.load()) {
+          Signal(consumers[key]);
+          return SwitchStatus::Closed;
+        }
+
+        // ring is empty; block until the next production
+        auto const next = consumers[key].next;
+        consumers[key].counters.BeginBlock();
+        lock.unlock();
+        auto const isAvailable = WaitUntil(waitStrategy, notifier, [&]() -> bool {
+          return (published.load() > next || isClosed.load());
+        }, deadline);
+        lock.lock();
+        consumers[key].counters.EndBlock();
+
+        if (!isAvailable) {
+          Signal(consumers[key]);
+          return SwitchStatus::Empty;
+        }
       }
-    };
-    using Consumers = std::vector<Consumer>;
 
-    Ring ring;
-    Producer producer;
-    Consumers consumers;
-    std::mutex mtx;
+      Signal(consumers[key]);
+      return SwitchStatus::Ready;
+    }
 
-    SwitchBufferImpl(size_t ringBufferSize)
-      : ring(ringBufferSize)
-      , producer(&ring)
+    /// determine consumer storage and release its previous buffer and promise
+    Consumer &Restart(SlotKey key)
     {
-      if (ringBufferSize <= 1U)
-        throw std::logic_error("SwitchBuffer: ring buffer size must be larger than 1");
+      auto &&consumer = consumers[key];
+
+      Unpin(consumer);
+      if (consumer.promise) {
+        consumer.counters.EndBlock();
+        Unpromise(key);
+      }
 
-      for (auto &&slot : ring)
-        slot.reset(new Buffer);
+      return consumer;
     }
 
-    SwitchBufferImpl(const SwitchBufferImpl &) = delete;
-    SwitchBufferImpl(SwitchBufferImpl &&) = delete;
+    /// create a promise to fulfill on next production
+    std::future<Buffer const &> Promise(SlotKey key, Consumer &consumer)
+    {
+      consumer.promise.emplace(std::allocator_arg, ResourceAllocator<char>(resource));
+      auto future = consumer.promise->get_future();
+      promised.push_back(key);
+      waiting.fetch_add(1U);
 
-    ~SwitchBufferImpl()
+      // recheck in case the producer published before noticing the promise
+      if (Acquire(consumer, !consumer.isReliable)) {
+        consumer.promise->set_value(consumer.pinned->Get());
+        Unpromise(key);
+      } else {
+        consumer.counters.BeginBlock();
+      }
+
+      return future;
+    }
+
+    /// drop the open promise or suspended coroutine of a consumer, breaking the promise unless fulfilled
+    void Unpromise(SlotKey key)
     {
-      assert(consumers.empty());
+      consumers[key].promise.reset();
+      consumers[key].awaiting = Awaiting();
+
+      Erase(promised, key);
+      waiting.fetch_sub(1U);
     }
 
-    SwitchBufferImpl &operator=(const SwitchBufferImpl &) = delete;
-    SwitchBufferImpl &operator=(SwitchBufferImpl &&) = delete;
+    /// remove a consumer from a list of consumers, in any order
+    static void Erase(Vector<SlotKey> &keys, SlotKey key)
+    {
+      auto const it = std::find_if(std::begin(keys), std::end(keys),
+        [key](SlotKey const &other) -> bool {
+          return (other.index == key.index);
+        });
+      assert(it != std::end(keys));
+      *it = keys.back();
+      keys.pop_back();
+    }
 
-    void CreateConsumer(SwitchBufferConsumer<Buffer> const *parent)
+#ifdef SWITCHBUFFER_COROUTINE
+    /// @brief  release the previous buffer of a consumer and acquire the next one without suspending
+    /// @return  false if the coroutine is to suspend on an empty ring
+    bool AwaitReady(SlotKey key, bool skipToMostRecent)
     {
       std::lock_guard<std::mutex> lock(mtx);
 
-      consumers.emplace_back(Consumer(parent, &ring));
+      auto &&consumer = Restart(key);
+      auto const isReady = (Acquire(consumer, skipToMostRecent) || isClosed.load());
+      Signal(consumer);
+      return isReady;
     }
 
-    void CloseProducer()
+    /// @brief  register a coroutine to resume on the next production
+    /// @return  false if a buffer arrived or the producer shut down meanwhile, not to suspend after all
+    bool AwaitSuspend(SlotKey key, Awaiting awaiting)
     {
       std::lock_guard<std::mutex> lock(mtx);
 
-      producer.isClosed = true;
+      // recheck in case the producer published before noticing the coroutine
+      auto &&consumer = consumers[key];
+      if (Acquire(consumer, !consumer.isReliable) || isClosed.load()) {
+        Signal(consumer);
+        return false;
+      }
 
-      // if there are open promises, break them
-      for (auto &&consumer : consumers)
-        consumer.promise.reset();
+      consumer.awaiting = awaiting;
+      promised.push_back(key);
+      waiting.fetch_add(1U);
+      consumer.counters.BeginBlock();
+      return true;
     }
 
-    void CloseConsumer(SwitchBufferConsumer<Buffer> const *parent)
+    /// @return  the buffer acquired for a coroutine, nullptr if the producer has shut down
+    Buffer const *AwaitResume(SlotKey key, Sequence &sequence)
     {
       std::lock_guard<std::mutex> lock(mtx);
 
-      auto const it = std::find(std::begin(consumers), std::end(consumers), parent);
-      assert(it != std::end(consumers));
-      (void)consumers.erase(it);
+      auto &&consumer = consumers[key];
+      if (!consumer.pinned)
+        return nullptr;
+      sequence = consumer.sequence;
+      return &consumer.pinned->Get();
     }
+#endif // SWITCHBUFFER_COROUTINE
 
-    Buffer &SwitchProducer()
+#ifdef SWITCHBUFFER_EVENTFD
+    int OpenReadiness(SlotKey key)
     {
       std::lock_guard<std::mutex> lock(mtx);
 
-      // advance ring iterators
-      producer.curr = producer.next;
-      ++producer.next;
-      if (producer.olde == producer.next) {
-        ++producer.olde;
-      } else if (!producer.olde) {
-        producer.olde = producer.curr;
+      auto &&consumer = consumers[key];
+      if (!consumer.readiness.IsOpen()) {
+        (void)consumer.readiness.Open();
+        polled.push_back(key);
+        polling.fetch_add(1U);
+        Signal(consumer);
       }
+      return consumer.readiness.Open();
+    }
+#endif // SWITCHBUFFER_EVENTFD
 
-      if (producer.curr) {
-        // notify consumers that something has been produced
-        for (auto &&consumer : consumers) {
-          if (consumer.promise) {
-            assert(consumer.isEmpty);
-            consumer.pos = producer.curr;
+    /// update the limit after a reliable consumer moved on
+    void Relieve(Consumer &consumer)
+    {
+      // only the slowest reliable consumer determines the limit; O(log R) to find the new one
+      SiftDown(consumer.rank);
+      Relieve();
+    }
 
-            // fulfill open promise
-            consumer.promise->set_value(**consumer.pos);
-            consumer.promise.reset();
-          } else {
-            consumer.isEmpty = false;
+    /// @brief  recompute how far the producers may claim without lapping the slowest reliable consumer,
+    ///         on top of the heap, and wake the producers waiting for it
+    void Relieve()
+    {
+      // keep the published buffers within the ring size - 1 that consumers regard as not overwritten
+      auto const end = (reliable.empty() ?
+        std::numeric_limits<Sequence>::max() : consumers[reliable.front()].next + ring.size() - 1U);
+      if (end != limit.load(std::memory_order_relaxed)) {
+        // sequentially consistent, so either a producer about to wait sees the new limit
+        // or Notify sees the producer waiting
+        limit.store(end);
+        backpressure.Notify();
+      }
+    }
 
-            if (producer.next == consumer.pos) {
-              // save buffer that is currently consumed
-              std::swap(*producer.next, consumer.sanctuary);
+    /// move an entry of the heap of reliable consumers up while ahead of its parent
+    void SiftUp(size_t pos)
+    {
+      while (pos > 0U) {
+        auto const parent = (pos - 1U) / 2U;
+        if (consumers[reliable[parent]].next <= consumers[reliable[pos]].next)
+          return;
+        SwapReliable(pos, parent);
+        pos = parent;
+      }
+    }
 
-              consumer.isFull = true;
-            } else if (consumer.isFull) {
-              consumer.pos = producer.next;
-            }
-          }
+    /// move an entry of the heap of reliable consumers down while behind a child
+    void SiftDown(size_t pos)
+    {
+      for (;;) {
+        auto slowest = pos;
+        for (auto child = 2U * pos + 1U; child <= 2U * pos + 2U && child < reliable.size(); ++child) {
+          if (consumers[reliable[child]].next < consumers[reliable[slowest]].next)
+            slowest = child;
         }
-      } else {
-        // no consumable buffer yet
+        if (slowest == pos)
+          return;
+        SwapReliable(pos, slowest);
+        pos = slowest;
       }
+    }
 
-      return **producer.next;
+    void SwapReliable(size_t a, size_t b)
+    {
+      std::swap(reliable[a], reliable[b]);
+      consumers[reliable[a]].rank = a;
+      consumers[reliable[b]].rank = b;
     }
 
-    std::future<Buffer const &> SwitchConsumer(
-      SwitchBufferConsumer<Buffer> const *parent, bool skipToMostRecent)
+    /// raise or clear the file descriptor of a consumer, if any,
+    /// to reflect whether its next switch finds a buffer or the producer gone
+    void Signal(Consumer &consumer)
     {
-      std::lock_guard<std::mutex> lock(mtx);
+      if (!consumer.readiness.IsOpen())
+        return;
 
-      // determine consumer storage
-      auto const it = std::find(std::begin(consumers), std::end(consumers), parent);
-      assert(it != std::end(consumers));
-      auto &&consumer = *it;
+      if (published.load() > consumer.next || isClosed.load())
+        consumer.readiness.Raise();
+      else
+        consumer.readiness.Clear();
+    }
 
-      if (consumer.isEmpty) {
-        if (producer.isClosed) {
-          // create a promise to be broken immediately
-          return std::promise<Buffer const &>().get_future();
-        } else {
-          // create a promise to fulfill on next Production
-          consumer.promise.emplace();
-          return consumer.promise->get_future();
+    /// pin all consumable buffers, if any
+    bool AcquireBatch(Consumer &consumer)
+    {
+      assert(consumer.batch.empty());
+
+      // reserve for the largest batch possible once
+      if (consumer.batch.capacity() < ring.size()) {
+        consumer.batch.reserve(ring.size());
+        consumer.batchBuffers.reserve(ring.size());
+        consumer.batchSequences.reserve(ring.size());
+      }
+
+      auto const avail = published.load(std::memory_order_acquire);
+      if (consumer.next >= avail)
+        return false;
+
+      auto const oldest = std::max(consumer.next, Protocol::Oldest(avail, ring.size()));
+      for (auto seq = oldest; seq < avail; ++seq) {
+        // skip whatever the producers have overwritten already;
+        // with several producers, these need not be the oldest buffers
+        Cell *cell;
+        if (protocol.Pin(ring, seq, cell)) {
+          consumer.batch.push_back(cell);
+          consumer.batchBuffers.push_back(&cell->Get());
+          consumer.batchSequences.push_back(seq);
         }
+      }
+
+      consumer.counters.Consume(consumer.batch.size());
+      consumer.counters.Overwrite(avail - consumer.next - consumer.batch.size());
+      consumer.next = avail;
+      if (!consumer.batch.empty())
+        consumer.sequence = consumer.batchSequences.back();
+      if (consumer.isReliable)
+        Relieve(consumer);
+      return !consumer.batch.empty();
+    }
+
+    /// pin the next consumable buffer, if any
+    bool Acquire(Consumer &consumer, bool skipToMostRecent)
+    {
+      assert(!consumer.pinned && consumer.batch.empty());
+
+      auto const isAcquired = protocol.Acquire(ring, published,
+        consumer.next, skipToMostRecent, consumer.pinned, consumer.counters);
+      if (isAcquired)
+        consumer.sequence = consumer.next - 1U;
+      if (consumer.isReliable)
+        Relieve(consumer);
+      return isAcquired;
+    }
+
+    void Unpin(Consumer &consumer)
+    {
+      if (consumer.pinned) {
+        protocol.Unpin(consumer.pinned);
+        consumer.pinned = nullptr;
+      }
+
+      for (auto &&cell : consumer.batch)
+        protocol.Unpin(cell);
+      consumer.batch.clear();
+      consumer.batchBuffers.clear();
+      consumer.batchSequences.clear();
+    }
+
+    Cell *Spare(Producer &producer)
+    {
+      if (auto const cell = protocol.TakeSpare(producer.spares)) {
+        return cell;
       } else {
-        // advance ring iterator
-        if (skipToMostRecent) {
-          consumer.pos = producer.curr;
-          consumer.isEmpty = true;
+        // more buffers in consumption at overwrite than ever before, or
+        // the spares still on their way back to the free list; grow the pool
+        std::lock_guard<std::mutex> lock(sparesMtx);
+        spares.emplace_back(resource, 1U, 0U);
+        return &spares.back()[0];
+      }
+    }
+
+    void Fulfill(Producer &producer)
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+
+      // only visit the consumers that wait, not all of them
+      for (size_t i = promised.size(); i > 0U; --i) {
+        auto const key = promised[i - 1U];
+        auto &&consumer = consumers[key];
+        assert(!consumer.pinned);
+
+        // fulfill open promise or resume suspended coroutine with the most recent buffer,
+        // or the next one for a reliable consumer
+        if (Acquire(consumer, !consumer.isReliable)) {
+          if (consumer.promise) {
+            consumer.promise->set_value(consumer.pinned->Get());
+            consumer.promise.reset();
+          } else {
+            producer.resumed.push_back(consumer.awaiting);
+            consumer.awaiting = Awaiting();
+          }
+          consumer.counters.EndBlock();
+          promised[i - 1U] = promised.back();
+          promised.pop_back();
+          waiting.fetch_sub(1U);
+        }
+      }
+
+      for (auto &&key : polled)
+        Signal(consumers[key]);
+    }
+
+    /// invoke the inline callbacks with the newly published buffers and wake the delivery threads
+    void Call()
+    {
+      std::lock_guard<std::mutex> lock(callbacksMtx);
+
+      for (auto &&callback : callbacks) {
+        if (callback->isAsync.load(std::memory_order_relaxed))
+          callback->Wake();
+        else if (!Deliver(*callback, true))
+          Demote(*callback);
+      }
+    }
+
+    /// @brief  invoke a callback with all buffers published since its last invocation
+    /// @return  false if an invocation took longer than the budget, leaving the later buffers
+    bool Deliver(Callback &callback, bool isInline)
+    {
+      auto const avail = published.load(std::memory_order_acquire);
+      for (auto seq = std::max(callback.next, Protocol::Oldest(avail, ring.size())); seq < avail; ++seq) {
+        // skip whatever the producers have overwritten already
+        Cell *cell;
+        if (!protocol.Pin(ring, seq, cell))
+          continue;
+
+        callback.next = seq + 1U;
+        if (isInline) {
+          auto const start = std::chrono::steady_clock::now();
+          callback.function(cell->Get());
+          auto const elapsed = std::chrono::steady_clock::now() - start;
+          protocol.Unpin(cell);
+          if (elapsed > callback.budget)
+            return false;
         } else {
-          consumer.pos = (consumer.pos ? std::next(consumer.pos) : producer.olde);
-          consumer.isEmpty = (consumer.pos == producer.curr);
+          callback.function(cell->Get());
+          protocol.Unpin(cell);
         }
-        consumer.isFull = false;
+      }
+      callback.next = std::max(callback.next, avail);
+      return true;
+    }
 
-        // return buffer immediately
-        std::promise<Buffer const &> p;
-        p.set_value(**consumer.pos);
-        return p.get_future();
+    /// hand a callback over to a delivery thread of its own, starting with the undelivered buffers
+    void Demote(Callback &callback)
+    {
+      callback.isAsync.store(true, std::memory_order_relaxed);
+      callback.isPending = true;
+      callback.thread = std::thread([this, &callback]() {
+        for (;;) {
+          {
+            std::unique_lock<std::mutex> lock(callback.mtx);
+            callback.cv.wait(lock, [&callback]() -> bool {
+              return (callback.isPending || callback.isStopping);
+            });
+            if (callback.isStopping)
+              return;
+            callback.isPending = false;
+          }
+
+          (void)Deliver(callback, false);
+        }
+      });
+    }
+
+    /// resume the coroutines collected by Fulfill or CloseProducer, outside of the lock
+    void Resume(Producer &producer)
+    {
+      // a coroutine resumed inline may well run on into this producer again
+      while (!producer.resumed.empty()) {
+        auto const awaiting = producer.resumed.back();
+        producer.resumed.pop_back();
+        awaiting.Resume();
       }
     }
   };
 } // namespace detail
 
-template<typename Buffer>
-SwitchBufferProducer<Buffer>::~SwitchBufferProducer()
+template<typename Buffer, size_t RingSize>
+SwitchBufferProducer<Buffer, RingSize>::~SwitchBufferProducer()
 {
-  m_impl->CloseProducer();
+  if (m_impl)
+    m_impl->CloseProducer(m_state);
 }
 
-template<typename Buffer>
-SwitchBufferProducer<Buffer>::SwitchBufferProducer(SwitchBufferProducer<Buffer> &&other) noexcept
+template<typename Buffer, size_t RingSize>
+SwitchBufferProducer<Buffer, RingSize>::SwitchBufferProducer(SwitchBufferProducer<Buffer, RingSize> &&other) noexcept
   : m_impl(std::move(other.m_impl))
+  , m_state(std::move(other.m_state))
 {}
 
-template<typename Buffer>
-SwitchBufferProducer<Buffer> &
-SwitchBufferProducer<Buffer>::operator=(SwitchBufferProducer<Buffer> &&other) noexcept
+template<typename Buffer, size_t RingSize>
+SwitchBufferProducer<Buffer, RingSize> &
+SwitchBufferProducer<Buffer, RingSize>::operator=(SwitchBufferProducer<Buffer, RingSize> &&other) noexcept
 {
-  m_impl = std::move(other.m_impl);
+  if (this != &other) {
+    if (m_impl)
+      m_impl->CloseProducer(m_state);
+    m_impl = std::move(other.m_impl);
+    m_state = std::move(other.m_state);
+  }
   return *this;
 }
 
-template<typename Buffer>
-Buffer &SwitchBufferProducer<Buffer>::Switch()
+template<typename Buffer, size_t RingSize>
+Buffer &SwitchBufferProducer<Buffer, RingSize>::Switch()
+{
+  return m_impl->SwitchProducer(m_state);
+}
+
+template<typename Buffer, size_t RingSize>
+Buffer *SwitchBufferProducer<Buffer, RingSize>::TrySwitch()
+{
+  return m_impl->TrySwitchProducer(m_state);
+}
+
+template<typename Buffer, size_t RingSize>
+template<typename ResetFunction>
+Buffer &SwitchBufferProducer<Buffer, RingSize>::Switch(ResetFunction &&reset)
+{
+  return m_impl->ResetProducer(m_state, std::forward<ResetFunction>(reset));
+}
+
+template<typename Buffer, size_t RingSize>
+template<typename... Args>
+Buffer &SwitchBufferProducer<Buffer, RingSize>::Emplace(Args&&... args)
+{
+  return m_impl->EmplaceProducer(m_state, std::forward<Args>(args)...);
+}
+
+template<typename Buffer, size_t RingSize>
+typename SwitchBufferProducer<Buffer, RingSize>::Batch
+SwitchBufferProducer<Buffer, RingSize>::SwitchBatch(size_t count)
+{
+  return Batch(m_impl->SwitchProducerBatch(m_state, count), count);
+}
+
+template<typename Buffer, size_t RingSize>
+void SwitchBufferProducer<Buffer, RingSize>::Publish()
 {
-  return m_impl->SwitchProducer();
+  m_impl->Publish(m_state);
 }
 
-template<typename Buffer>
-SwitchBufferProducer<Buffer>::SwitchBufferProducer(
-  std::shared_ptr<detail::SwitchBufferImpl<Buffer>> impl)
+template<typename Buffer, size_t RingSize>
+SwitchBufferProducer<Buffer, RingSize>::SwitchBufferProducer(
+  std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> impl)
   : m_impl(std::move(impl))
+  , m_state(m_impl->CreateProducer())
 {}
 
 
-template<typename Buffer>
-SwitchBufferConsumer<Buffer>::~SwitchBufferConsumer()
+template<typename Buffer, size_t RingSize>
+SwitchBufferConsumer<Buffer, RingSize>::~SwitchBufferConsumer()
 {
-  m_impl->CloseConsumer(this);
+  m_impl->CloseConsumer(m_key);
 }
 
-template<typename Buffer>
-std::future<Buffer const &> SwitchBufferConsumer<Buffer>::Switch(bool skipToMostRecent)
+template<typename Buffer, size_t RingSize>
+std::future<Buffer const &> SwitchBufferConsumer<Buffer, RingSize>::Switch(bool skipToMostRecent)
 {
-  return m_impl->SwitchConsumer(this, skipToMostRecent);
+  return m_impl->SwitchConsumer(m_key, skipToMostRecent);
 }
 
-template<typename Buffer>
-SwitchBufferConsumer<Buffer>::SwitchBufferConsumer(
-  std::shared_ptr<detail::SwitchBufferImpl<Buffer>> impl)
-  : m_impl(std::move(impl))
+template<typename Buffer, size_t RingSize>
+typename SwitchBufferConsumer<Buffer, RingSize>::Result
+SwitchBufferConsumer<Buffer, RingSize>::SwitchWait(bool skipToMostRecent)
+{
+  Buffer const *buffer = nullptr;
+  std::uint64_t sequence = 0U;
+  auto const status = m_impl->SwitchConsumerWait(m_key, skipToMostRecent, m_waitStrategy,
+    std::chrono::steady_clock::time_point::max(), buffer, sequence);
+  return Result{status, buffer, sequence};
+}
+
+template<typename Buffer, size_t RingSize>
+typename SwitchBufferConsumer<Buffer, RingSize>::Result
+SwitchBufferConsumer<Buffer, RingSize>::TrySwitch(bool skipToMostRecent)
+{
+  Buffer const *buffer = nullptr;
+  std::uint64_t sequence = 0U;
+  auto const status = m_impl->SwitchConsumerTry(m_key, skipToMostRecent, buffer, sequence);
+  return Result{status, buffer, sequence};
+}
+
+template<typename Buffer, size_t RingSize>
+template<typename Rep, typename Period>
+typename SwitchBufferConsumer<Buffer, RingSize>::Result
+SwitchBufferConsumer<Buffer, RingSize>::SwitchFor(
+  std::chrono::duration<Rep, Period> const &timeout, bool skipToMostRecent)
+{
+  using Clock = std::chrono::steady_clock;
+
+  // wait indefinitely rather than overflow the deadline; compare in floating point, as converting
+  // e.g. hours::max() to the units of the clock, or the clock range to milliseconds in an int overflows
+  using Nanoseconds = std::chrono::duration<long double, std::nano>;
+  auto const now = Clock::now();
+  auto const deadline = (Nanoseconds(timeout) < Nanoseconds(Clock::time_point::max() - now) ?
+    now + std::chrono::duration_cast<Clock::duration>(timeout) : Clock::time_point::max());
+
+  Buffer const *buffer = nullptr;
+  std::uint64_t sequence = 0U;
+  auto const status = m_impl->SwitchConsumerWait(m_key, skipToMostRecent, m_waitStrategy, deadline,
+    buffer, sequence);
+  return Result{status, buffer, sequence};
+}
+
+template<typename Buffer, size_t RingSize>
+template<typename Clock, typename Duration>
+typename SwitchBufferConsumer<Buffer, RingSize>::Result
+SwitchBufferConsumer<Buffer, RingSize>::SwitchUntil(
+  std::chrono::time_point<Clock, Duration> const &deadline, bool skipToMostRecent)
+{
+  // subtracting the current time from a far deadline may overflow
+  if (deadline == std::chrono::time_point<Clock, Duration>::max())
+    return SwitchFor(std::chrono::steady_clock::duration::max(), skipToMostRecent);
+  return SwitchFor(deadline - Clock::now(), skipToMostRecent);
+}
+
+template<typename Buffer, size_t RingSize>
+typename SwitchBufferConsumer<Buffer, RingSize>::Batch
+SwitchBufferConsumer<Buffer, RingSize>::SwitchBatch()
+{
+  Batch batch;
+  batch.status = (m_impl->SwitchConsumerBatch(m_key, m_waitStrategy,
+      batch.m_buffers, batch.m_sequences, batch.m_size) ?
+    SwitchStatus::Ready : SwitchStatus::Closed);
+  return batch;
+}
+
+template<typename Buffer, size_t RingSize>
+std::uint64_t SwitchBufferConsumer<Buffer, RingSize>::GetSequence() const
+{
+  return m_impl->GetSequence(m_key);
+}
+
+template<typename Buffer, size_t RingSize>
+void SwitchBufferConsumer<Buffer, RingSize>::SetWaitStrategy(WaitStrategy waitStrategy) noexcept
+{
+  m_waitStrategy = waitStrategy;
+}
+
+#ifdef SWITCHBUFFER_COROUTINE
+template<typename Buffer, size_t RingSize>
+typename SwitchBufferConsumer<Buffer, RingSize>::Awaiter
+SwitchBufferConsumer<Buffer, RingSize>::Next(bool skipToMostRecent)
+{
+  return Awaiter(this, skipToMostRecent);
+}
+
+template<typename Buffer, size_t RingSize>
+void SwitchBufferConsumer<Buffer, RingSize>::SetResumeFunction(ResumeFunction resume, void *context) noexcept
+{
+  m_resume = resume;
+  m_resumeContext = context;
+}
+
+template<typename Buffer, size_t RingSize>
+bool SwitchBufferConsumer<Buffer, RingSize>::Awaiter::await_ready()
+{
+  return m_consumer->m_impl->AwaitReady(m_consumer->m_key, m_skipToMostRecent);
+}
+
+template<typename Buffer, size_t RingSize>
+bool SwitchBufferConsumer<Buffer, RingSize>::Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+  return m_consumer->m_impl->AwaitSuspend(m_consumer->m_key,
+    detail::Awaiting{handle, m_consumer->m_resume, m_consumer->m_resumeContext});
+}
+
+template<typename Buffer, size_t RingSize>
+typename SwitchBufferConsumer<Buffer, RingSize>::Result
+SwitchBufferConsumer<Buffer, RingSize>::Awaiter::await_resume()
+{
+  std::uint64_t sequence = 0U;
+  auto const buffer = m_consumer->m_impl->AwaitResume(m_consumer->m_key, sequence);
+  return Result{(buffer ? SwitchStatus::Ready : SwitchStatus::Closed), buffer, sequence};
+}
+#endif // SWITCHBUFFER_COROUTINE
+
+#ifdef SWITCHBUFFER_EVENTFD
+template<typename Buffer, size_t RingSize>
+int SwitchBufferConsumer<Buffer, RingSize>::GetFileDescriptor()
 {
-  m_impl->CreateConsumer(this);
+  return m_impl->OpenReadiness(m_key);
 }
+#endif // SWITCHBUFFER_EVENTFD
 
+template<typename Buffer, size_t RingSize>
+ConsumerStatistics SwitchBufferConsumer<Buffer, RingSize>::GetStatistics() const
+{
+  return m_impl->GetStatistics(m_key);
+}
 
-template<typename Buffer>
-SwitchBuffer<Buffer>::SwitchBuffer(size_t ringBufferSize)
-  : m_impl(new detail::SwitchBufferImpl<Buffer>(ringBufferSize))
-  , m_producer(new SwitchBufferProducer<Buffer>(m_impl))
+template<typename Buffer, size_t RingSize>
+SwitchBufferConsumer<Buffer, RingSize>::SwitchBufferConsumer(
+  std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> impl, WaitStrategy waitStrategy,
+  ConsumerMode consumerMode)
+  : m_impl(std::move(impl))
+  , m_key(m_impl->CreateConsumer(consumerMode == ConsumerMode::Reliable))
+  , m_waitStrategy(waitStrategy)
+#ifdef SWITCHBUFFER_COROUTINE
+  , m_resume(nullptr)
+  , m_resumeContext(nullptr)
+#endif // SWITCHBUFFER_COROUTINE
 {}
 
-template<typename Buffer>
-SwitchBuffer<Buffer>::~SwitchBuffer() = default;
 
-template<typename Buffer>
-SwitchBuffer<Buffer>::SwitchBuffer(SwitchBuffer<Buffer> &&other) noexcept
+template<typename Buffer, size_t RingSize>
+SwitchBufferCallbackConsumer<Buffer, RingSize>::~SwitchBufferCallbackConsumer()
+{
+  m_impl->RemoveCallback(m_state);
+}
+
+template<typename Buffer, size_t RingSize>
+bool SwitchBufferCallbackConsumer<Buffer, RingSize>::IsDemoted() const noexcept
+{
+  return m_state.isAsync.load(std::memory_order_relaxed);
+}
+
+template<typename Buffer, size_t RingSize>
+SwitchBufferCallbackConsumer<Buffer, RingSize>::SwitchBufferCallbackConsumer(
+  std::shared_ptr<detail::SwitchBufferImpl<Buffer, RingSize>> impl,
+  Function callback, std::chrono::nanoseconds budget)
+  : m_impl(std::move(impl))
+  , m_state(std::move(callback), budget)
+{
+  m_impl->AddCallback(m_state);
+}
+
+
+template<typename Buffer, size_t RingSize>
+SwitchBuffer<Buffer, RingSize>::SwitchBuffer(ProducerMode producerMode,
+  SwitchBufferMemoryResource *memoryResource)
+  : m_impl(detail::SwitchBufferImpl<Buffer, RingSize>::Create(memoryResource, producerMode))
+  , m_producer(new SwitchBufferProducer<Buffer, RingSize>(m_impl))
+{
+  static_assert(RingSize != 0U, "SwitchBuffer: ring buffer size required");
+}
+
+template<typename Buffer, size_t RingSize>
+SwitchBuffer<Buffer, RingSize>::SwitchBuffer(size_t ringBufferSize, bool powerOfTwo,
+  ProducerMode producerMode, SwitchBufferMemoryResource *memoryResource)
+  : m_impl(detail::SwitchBufferImpl<Buffer, RingSize>::Create(memoryResource,
+      producerMode, ringBufferSize, powerOfTwo))
+  , m_producer(new SwitchBufferProducer<Buffer, RingSize>(m_impl))
+{
+  static_assert(RingSize == 0U, "SwitchBuffer: ring buffer size given at compile time");
+}
+
+template<typename Buffer, size_t RingSize>
+SwitchBuffer<Buffer, RingSize>::~SwitchBuffer() = default;
+
+template<typename Buffer, size_t RingSize>
+SwitchBuffer<Buffer, RingSize>::SwitchBuffer(SwitchBuffer<Buffer, RingSize> &&other) noexcept
   : m_impl(std::move(other.m_impl))
+  , m_producer(std::move(other.m_producer))
 {}
 
-template<typename Buffer>
-SwitchBuffer<Buffer> &
-SwitchBuffer<Buffer>::operator=(SwitchBuffer<Buffer> &&other) noexcept
+template<typename Buffer, size_t RingSize>
+SwitchBuffer<Buffer, RingSize> &
+SwitchBuffer<Buffer, RingSize>::operator=(SwitchBuffer<Buffer, RingSize> &&other) noexcept
 {
   m_impl = std::move(other.m_impl);
+  m_producer = std::move(other.m_producer);
   return *this;
 }
 
-template<typename Buffer>
-typename SwitchBuffer<Buffer>::Producer SwitchBuffer<Buffer>::GetProducer()
+template<typename Buffer, size_t RingSize>
+typename SwitchBuffer<Buffer, RingSize>::Producer SwitchBuffer<Buffer, RingSize>::GetProducer()
 {
-  if (!m_producer)
-    throw std::logic_error("SwitchBuffer: only one producer supported");
-  else
+  if (m_producer)
     return std::move(m_producer);
+  else if (m_impl->isMultiProducer)
+    return Producer(new SwitchBufferProducer<Buffer, RingSize>(m_impl));
+  else
+    throw std::logic_error("SwitchBuffer: only one producer supported");
+}
+
+template<typename Buffer, size_t RingSize>
+typename SwitchBuffer<Buffer, RingSize>::Consumer SwitchBuffer<Buffer, RingSize>::GetConsumer(
+  WaitStrategy waitStrategy, ConsumerMode consumerMode)
+{
+  return Consumer(new SwitchBufferConsumer<Buffer, RingSize>(m_impl, waitStrategy, consumerMode));
+}
+
+template<typename Buffer, size_t RingSize>
+typename SwitchBuffer<Buffer, RingSize>::CallbackConsumer SwitchBuffer<Buffer, RingSize>::GetCallbackConsumer(
+  typename SwitchBufferCallbackConsumer<Buffer, RingSize>::Function callback, std::chrono::nanoseconds budget)
+{
+  return CallbackConsumer(new SwitchBufferCallbackConsumer<Buffer, RingSize>(m_impl, std::move(callback), budget));
 }
 
-template<typename Buffer>
-typename SwitchBuffer<Buffer>::Consumer SwitchBuffer<Buffer>::GetConsumer()
+template<typename Buffer, size_t RingSize>
+ConsumerStatistics SwitchBuffer<Buffer, RingSize>::GetStatistics() const
 {
-  return Consumer(new SwitchBufferConsumer<Buffer>(m_impl));
+  return m_impl->GetStatistics();
 }
 
 #endif // SWITCHBUFFER_IMPL_H
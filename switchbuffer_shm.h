@@ -0,0 +1,146 @@
+#ifndef SWITCHBUFFER_SHM_H
+#define SWITCHBUFFER_SHM_H
+
+#include "switchbuffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+template<typename Buffer>
+class SharedSwitchBuffer;
+
+namespace detail
+{
+  template<typename Buffer>
+  struct SharedSwitchBufferImpl;
+} // namespace detail
+
+/// @brief  interface to pass to the producer of a SharedSwitchBuffer,
+///         see SwitchBufferProducer
+/// @note  create via the SharedSwitchBuffer class
+template<typename Buffer>
+class SharedSwitchBufferProducer
+{
+  friend class SharedSwitchBuffer<Buffer>;
+
+public:
+  SharedSwitchBufferProducer(SharedSwitchBufferProducer const &) = delete;
+  SharedSwitchBufferProducer(SharedSwitchBufferProducer &&other) = delete;
+  ~SharedSwitchBufferProducer();
+
+  SharedSwitchBufferProducer &operator=(SharedSwitchBufferProducer const &) = delete;
+  SharedSwitchBufferProducer &operator=(SharedSwitchBufferProducer &&other) = delete;
+
+  /// @brief  get a writable buffer to produce into
+  /// @note  all but the initial call also publish the previous buffer to the consumers;
+  ///        the buffer holds whatever was last produced into it
+  Buffer &Switch();
+
+private:
+  /// created by SharedSwitchBuffer only
+  SharedSwitchBufferProducer(std::shared_ptr<detail::SharedSwitchBufferImpl<Buffer>> impl);
+
+private:
+  std::shared_ptr<detail::SharedSwitchBufferImpl<Buffer>> m_impl;
+  typename detail::SharedSwitchBufferImpl<Buffer>::Producer m_state; // producer state within m_impl
+};
+
+/// @brief  interface to pass to a consumer of a SharedSwitchBuffer,
+///         see SwitchBufferConsumer
+/// @note  create via the SharedSwitchBuffer class
+template<typename Buffer>
+class SharedSwitchBufferConsumer
+{
+  friend class SharedSwitchBuffer<Buffer>;
+
+public:
+  /// readable buffer as returned by SwitchWait
+  struct Result
+  {
+    SwitchStatus status;
+    Buffer const *buffer; ///< valid until the next switch if Ready, nullptr otherwise
+    std::uint64_t sequence; ///< sequence number of the buffer if Ready, see SwitchBufferConsumer::GetSequence
+
+    explicit operator bool() const noexcept
+    {
+      return (status == SwitchStatus::Ready);
+    }
+  };
+
+public:
+  SharedSwitchBufferConsumer(SharedSwitchBufferConsumer const &) = delete;
+  SharedSwitchBufferConsumer(SharedSwitchBufferConsumer &&other) = delete;
+  ~SharedSwitchBufferConsumer();
+
+  SharedSwitchBufferConsumer &operator=(SharedSwitchBufferConsumer const &) = delete;
+  SharedSwitchBufferConsumer &operator=(SharedSwitchBufferConsumer &&other) = delete;
+
+  /// @brief  get a readable buffer to consume from
+  /// @param[in]  skipToMostRecent  see SwitchBufferConsumer::Switch
+  /// @note  returns immediately if a buffer is available and
+  ///        only waits on an empty ring, according to the wait strategy
+  Result SwitchWait(bool skipToMostRecent = false);
+
+  /// set how SwitchWait waits on an empty ring
+  void SetWaitStrategy(WaitStrategy waitStrategy) noexcept;
+
+private:
+  /// created by SharedSwitchBuffer only
+  SharedSwitchBufferConsumer(std::shared_ptr<detail::SharedSwitchBufferImpl<Buffer>> impl,
+    WaitStrategy waitStrategy);
+
+private:
+  std::shared_ptr<detail::SharedSwitchBufferImpl<Buffer>> m_impl;
+  typename detail::SharedSwitchBufferImpl<Buffer>::Consumer m_state; // consumer state within m_impl
+  WaitStrategy m_waitStrategy;
+};
+
+/// @brief  SwitchBuffer in a named POSIX shared memory segment, for a producer and
+///         consumers in different processes
+/// @note  the segment holds no pointers, so every process may map it at another address;
+///        Buffer must be trivially copyable and is default-constructed once by the creator.
+///        A process dying while holding an interface is not recovered from: its consumer
+///        seat and pinned buffer stay taken, and a producer dying never closes the buffer.
+template<typename Buffer>
+class SharedSwitchBuffer
+{
+public:
+  using Producer = typename std::unique_ptr<SharedSwitchBufferProducer<Buffer>>;
+  using Consumer = typename std::unique_ptr<SharedSwitchBufferConsumer<Buffer>>;
+
+public:
+  /// @brief  create the shared memory segment
+  /// @param[in]  name  POSIX shared memory object name, e.g. "/camera", must not exist yet
+  /// @param[in]  ringBufferSize  number of buffers in the ring, at least 2
+  /// @param[in]  maxConsumers  number of consumers that may be attached at once, over all processes
+  /// @note  the name is unlinked again once this and all interfaces of this process are gone;
+  ///        processes attached by then keep working on the segment
+  SharedSwitchBuffer(std::string const &name, size_t ringBufferSize, size_t maxConsumers);
+
+  /// @brief  attach to a segment created by another process
+  /// @param[in]  name  name of a segment created with the same Buffer type
+  explicit SharedSwitchBuffer(std::string const &name);
+  SharedSwitchBuffer(SharedSwitchBuffer const &) = delete;
+  SharedSwitchBuffer(SharedSwitchBuffer &&other) noexcept = default;
+  ~SharedSwitchBuffer() = default;
+
+  SharedSwitchBuffer &operator=(SharedSwitchBuffer const &) = delete;
+  SharedSwitchBuffer &operator=(SharedSwitchBuffer &&other) noexcept = default;
+
+  /// @brief  get an interface to pass to the producer
+  /// @note  succeeds once per segment, over all processes
+  Producer GetProducer();
+
+  /// @brief  get an interface to pass to a consumer
+  /// @param[in]  waitStrategy  how the consumer waits in SwitchWait on an empty ring;
+  ///                           without a futex, SpinPark sleeps in fixed intervals instead
+  Consumer GetConsumer(WaitStrategy waitStrategy = WaitStrategy());
+
+private:
+  std::shared_ptr<detail::SharedSwitchBufferImpl<Buffer>> m_impl;
+};
+
+#include "switchbuffer_shm_impl.h"
+
+#endif // SWITCHBUFFER_SHM_H
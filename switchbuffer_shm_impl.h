@@ -0,0 +1,577 @@
+#ifndef SWITCHBUFFER_SHM_IMPL_H
+#define SWITCHBUFFER_SHM_IMPL_H
+
+#ifndef SWITCHBUFFER_SHM_H
+# error Include this file via switchbuffer_shm.h only
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace detail
+{
+#ifdef SWITCHBUFFER_FUTEX
+  using SharedNotifier = FutexNotifier<true>;
+#else
+  /// @brief  stand-in for the process-shared futex: waiters poll instead of blocking
+  /// @note  holds no process-local state, so it may live in shared memory
+  class SharedNotifier
+  {
+  public:
+    template<typename Predicate>
+    void Wait(Predicate pred)
+    {
+      while (!pred())
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    template<typename Predicate>
+    bool WaitUntil(Predicate pred, std::chrono::steady_clock::time_point deadline)
+    {
+      while (!pred()) {
+        auto const now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+          return false;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+          std::chrono::microseconds(100), deadline - now));
+      }
+      return true;
+    }
+
+    void Notify() noexcept
+    {}
+  };
+#endif // SWITCHBUFFER_FUTEX
+
+  /// mapping of a named POSIX shared memory segment into this process
+  class SharedMapping
+  {
+  public:
+    /// create the segment, zero-filled; fails if the name exists
+    SharedMapping(std::string const &name, size_t size)
+      : m_name(name)
+      , m_data(nullptr)
+      , m_size(size)
+      , m_isOwner(true)
+    {
+      auto const fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "SwitchBuffer: shm_open");
+
+      if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        auto const error = errno;
+        (void)::close(fd);
+        (void)::shm_unlink(name.c_str());
+        throw std::system_error(error, std::generic_category(), "SwitchBuffer: ftruncate");
+      }
+
+      Map(fd);
+    }
+
+    /// attach to an existing segment
+    explicit SharedMapping(std::string const &name)
+      : m_name(name)
+      , m_data(nullptr)
+      , m_size(0U)
+      , m_isOwner(false)
+    {
+      auto const fd = ::shm_open(name.c_str(), O_RDWR, 0);
+      if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "SwitchBuffer: shm_open");
+
+      struct stat st;
+      if (::fstat(fd, &st) != 0) {
+        auto const error = errno;
+        (void)::close(fd);
+        throw std::system_error(error, std::generic_category(), "SwitchBuffer: fstat");
+      }
+      m_size = static_cast<size_t>(st.st_size);
+
+      Map(fd);
+    }
+
+    SharedMapping(SharedMapping const &) = delete;
+
+    ~SharedMapping()
+    {
+      (void)::munmap(m_data, m_size);
+
+      // processes still attached keep the segment alive
+      if (m_isOwner)
+        (void)::shm_unlink(m_name.c_str());
+    }
+
+    SharedMapping &operator=(SharedMapping const &) = delete;
+
+    unsigned char *Data() const noexcept
+    {
+      return static_cast<unsigned char *>(m_data);
+    }
+
+    size_t Size() const noexcept
+    {
+      return m_size;
+    }
+
+  private:
+    void Map(int fd)
+    {
+      m_data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      auto const error = errno;
+      (void)::close(fd);
+
+      if (m_data == MAP_FAILED) {
+        if (m_isOwner)
+          (void)::shm_unlink(m_name.c_str());
+        throw std::system_error(error, std::generic_category(), "SwitchBuffer: mmap");
+      }
+    }
+
+  private:
+    std::string m_name;
+    void *m_data;
+    size_t m_size;
+    bool m_isOwner; // flag whether the name is to be unlinked on destruction
+  };
+
+  inline size_t AlignUp(size_t offset, size_t alignment) noexcept
+  {
+    return (offset + alignment - 1U) / alignment * alignment;
+  }
+
+  /// @brief  state of a SharedSwitchBuffer, all of it in the shared memory segment
+  ///         except for the mapping and the process-local views into it
+  /// @note  the segment references its parts by offsets and indices only,
+  ///        so that every process may map it at another address
+  template<typename Buffer>
+  struct SharedSwitchBufferImpl
+  {
+    static_assert(std::is_trivially_copyable<Buffer>::value,
+      "SwitchBuffer: shared memory buffers must be trivially copyable");
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+      "SwitchBuffer: shared memory requires lock-free atomics");
+
+    using Sequence = std::uint64_t;
+
+    static constexpr std::uint64_t tag = 0x53574255464D3031ULL; // tag of an initialized segment, incl. version
+
+    /// segment header, located at offset 0
+    struct alignas(cacheLineSize) Header
+    {
+      std::atomic<std::uint64_t> magic; // set by the creator once the segment is initialized
+      std::uint64_t bufferSize; // sizeof(Buffer) of the creator, to reject mismatching attachments
+      std::uint64_t bufferAlignment; // alignof(Buffer) of the creator
+      std::uint64_t ringSize;
+      std::uint64_t maxConsumers;
+      std::uint64_t segmentSize;
+      std::atomic<std::uint32_t> hasProducer; // flag whether the producer was handed out
+      std::atomic<std::uint32_t> isClosed; // flag whether the producer has shut down
+
+      alignas(cacheLineSize) std::atomic<Sequence> published; // number of published buffers
+      std::atomic<std::uint32_t> freed; // index of the first detached cell returned by the consumers
+
+      alignas(cacheLineSize) SharedNotifier notifier;
+    };
+
+    /// storage of a single buffer, referenced from one ring slot at a time, see SwitchBufferImpl::Cell
+    struct alignas(cacheLineSize) Cell
+    {
+      static constexpr bool isConstructed = true; // buffers are default-constructed once by the creator
+
+      std::atomic<std::uint32_t> pins; // number of consumers reading the buffer plus detached flag
+      std::uint32_t next; // index of the next cell within the free list
+      Buffer buffer;
+
+      Cell()
+        : pins(0U)
+        , next(CellIndices<Cell>::none)
+        , buffer()
+      {}
+    };
+    using Protocol = CellProtocol<CellIndices<Cell>>;
+
+    static constexpr std::uint32_t none = CellIndices<Cell>::none; // cell index terminating a list
+
+    struct alignas(cacheLineSize) Slot
+    {
+      std::atomic<Sequence> seq; // sequence number + 1 of the published buffer, 0 while in production
+      std::atomic<std::uint32_t> cell; // index of the cell currently occupying the slot
+
+      explicit Slot(std::uint32_t cell)
+        : seq(0U)
+        , cell(cell)
+      {}
+    };
+
+    /// process-local view of the ring slots in the segment, see detail::Ring
+    struct Ring
+    {
+      Slot *slots;
+      size_t m_size;
+
+      size_t size() const noexcept
+      {
+        return m_size;
+      }
+
+      size_t Index(Sequence seq) const noexcept
+      {
+        return static_cast<size_t>(seq % m_size);
+      }
+
+      Slot &operator[](size_t pos) const noexcept
+      {
+        return slots[pos];
+      }
+    };
+
+    /// registry entry of a consumer, over all processes
+    struct alignas(cacheLineSize) Seat
+    {
+      std::atomic<std::uint32_t> isTaken;
+
+      Seat()
+        : isTaken(0U)
+      {}
+    };
+
+    /// offsets of the segment parts
+    struct Layout
+    {
+      size_t ring;
+      size_t seats;
+      size_t cells;
+      size_t size;
+
+      Layout(size_t ringSize, size_t maxConsumers)
+        : ring(AlignUp(sizeof(Header), alignof(Slot)))
+        , seats(AlignUp(ring + ringSize * sizeof(Slot), alignof(Seat)))
+        , cells(AlignUp(seats + maxConsumers * sizeof(Seat), alignof(Cell)))
+        , size(cells + (ringSize + maxConsumers) * sizeof(Cell))
+      {}
+    };
+
+    struct Producer
+    {
+      Sequence seq; // sequence number of the in-production buffer
+      bool isClaimed; // flag whether the slot of seq is handed out to the producer
+      std::uint32_t spares; // detached cells taken over from the consumers
+
+      Producer()
+        : seq(0U)
+        , isClaimed(false)
+        , spares(none)
+      {}
+    };
+
+    struct Consumer
+    {
+      std::uint32_t seat; // index of the registry entry
+      Sequence next; // sequence number of the next buffer to consume
+      Sequence sequence; // sequence number of the buffer handed out last
+      std::uint32_t pinned; // in-consumption cell, protected from being overwritten, none if none
+
+      Consumer()
+        : seat(none)
+        , next(0U)
+        , sequence(0U)
+        , pinned(none)
+      {}
+    };
+
+    SharedMapping mapping;
+    Header *header;
+    Ring ring;
+    Seat *seats;
+    Cell *cells;
+    Protocol protocol; // slot and cell protocol over cells and the free list in header
+    size_t ringSize;
+    size_t maxConsumers;
+
+    /// create and initialize the segment
+    SharedSwitchBufferImpl(std::string const &name, size_t ringBufferSize, size_t maxConsumers)
+      : mapping(name, Layout(Validate(ringBufferSize, maxConsumers), maxConsumers).size)
+      , ringSize(ringBufferSize)
+      , maxConsumers(maxConsumers)
+    {
+      Layout const layout(ringSize, maxConsumers);
+      header = new (mapping.Data()) Header();
+      header->bufferSize = sizeof(Buffer);
+      header->bufferAlignment = alignof(Buffer);
+      header->ringSize = ringSize;
+      header->maxConsumers = maxConsumers;
+      header->segmentSize = layout.size;
+      header->freed.store(none, std::memory_order_relaxed);
+      View(layout);
+
+      // each slot starts out with a cell of its own, the remaining cells serve as spares
+      for (size_t i = 0U; i < ringSize; ++i)
+        new (&ring[i]) Slot(static_cast<std::uint32_t>(i));
+      for (size_t i = 0U; i < maxConsumers; ++i)
+        new (&seats[i]) Seat();
+      for (size_t i = 0U; i < ringSize + maxConsumers; ++i)
+        new (&cells[i]) Cell();
+      for (size_t i = ringSize; i < ringSize + maxConsumers; ++i)
+        protocol.Free(static_cast<std::uint32_t>(i));
+
+      header->magic.store(tag, std::memory_order_release);
+    }
+
+    /// attach to the segment
+    explicit SharedSwitchBufferImpl(std::string const &name)
+      : mapping(name)
+      , ringSize(0U)
+      , maxConsumers(0U)
+    {
+      if (mapping.Size() < sizeof(Header))
+        throw std::runtime_error("SwitchBuffer: shared memory segment not initialized");
+
+      header = reinterpret_cast<Header *>(mapping.Data());
+      if (header->magic.load(std::memory_order_acquire) != tag)
+        throw std::runtime_error("SwitchBuffer: shared memory segment not initialized or of another version");
+      if (header->bufferSize != sizeof(Buffer) || header->bufferAlignment != alignof(Buffer))
+        throw std::runtime_error("SwitchBuffer: shared memory segment created for another buffer type");
+
+      ringSize = static_cast<size_t>(header->ringSize);
+      maxConsumers = static_cast<size_t>(header->maxConsumers);
+      Layout const layout(ringSize, maxConsumers);
+      if (header->segmentSize != layout.size || mapping.Size() < layout.size)
+        throw std::runtime_error("SwitchBuffer: shared memory segment size mismatch");
+      View(layout);
+    }
+
+    static size_t Validate(size_t ringBufferSize, size_t maxConsumers)
+    {
+      if (ringBufferSize < 2U)
+        throw std::logic_error("SwitchBuffer: ring buffer size must be at least 2");
+      if (maxConsumers == 0U)
+        throw std::logic_error("SwitchBuffer: at least one consumer required");
+      if (ringBufferSize + maxConsumers >= none)
+        throw std::logic_error("SwitchBuffer: too many buffers for shared memory");
+      return ringBufferSize;
+    }
+
+    void View(Layout const &layout)
+    {
+      ring = Ring{reinterpret_cast<Slot *>(mapping.Data() + layout.ring), ringSize};
+      seats = reinterpret_cast<Seat *>(mapping.Data() + layout.seats);
+      cells = reinterpret_cast<Cell *>(mapping.Data() + layout.cells);
+      protocol = Protocol{CellIndices<Cell>{cells}, &header->freed};
+    }
+
+    Producer CreateProducer()
+    {
+      std::uint32_t expected = 0U;
+      if (!header->hasProducer.compare_exchange_strong(expected, 1U))
+        throw std::logic_error("SwitchBuffer: only one producer supported");
+
+      Producer producer;
+      producer.seq = header->published.load();
+      return producer;
+    }
+
+    Consumer CreateConsumer()
+    {
+      for (size_t i = 0U; i < maxConsumers; ++i) {
+        std::uint32_t expected = 0U;
+        if (seats[i].isTaken.compare_exchange_strong(expected, 1U)) {
+          // start with the next buffer to be published, see SwitchBufferImpl::CreateConsumer
+          Consumer consumer;
+          consumer.seat = static_cast<std::uint32_t>(i);
+          consumer.next = header->published.load();
+          return consumer;
+        }
+      }
+      throw std::logic_error("SwitchBuffer: too many consumers");
+    }
+
+    void CloseProducer(Producer &producer)
+    {
+      // hand back the cached spares, keeping the pool whole
+      protocol.ReturnSpares(producer.spares);
+
+      header->isClosed.store(1U);
+      header->notifier.Notify();
+    }
+
+    void CloseConsumer(Consumer &consumer)
+    {
+      Unpin(consumer);
+      seats[consumer.seat].isTaken.store(0U, std::memory_order_release);
+    }
+
+    Buffer &SwitchProducer(Producer &producer)
+    {
+      Publish(producer);
+
+      auto const index = protocol.Claim(ring, producer.seq, [&]() -> std::uint32_t {
+        return Spare(producer);
+      });
+
+      producer.isClaimed = true;
+      return cells[index].buffer;
+    }
+
+    void Publish(Producer &producer)
+    {
+      if (!producer.isClaimed)
+        return;
+
+      ring[ring.Index(producer.seq)].seq.store(producer.seq + 1U, std::memory_order_release);
+      ++producer.seq;
+      producer.isClaimed = false;
+      header->published.store(producer.seq);
+
+      // notify consumers that wait for something to be produced
+      header->notifier.Notify();
+    }
+
+    /// @return  nullptr if the producer has shut down and all buffers are consumed
+    Buffer const *SwitchConsumerWait(Consumer &consumer, bool skipToMostRecent,
+      WaitStrategy const &waitStrategy, Sequence &sequence)
+    {
+      Unpin(consumer);
+      while (!Acquire(consumer, skipToMostRecent)) {
+        if (header->isClosed.load())
+          return nullptr;
+
+        // ring is empty; wait for the next production,
+        // then continue with the most recent buffer
+        auto const next = consumer.next;
+        Wait(waitStrategy, header->notifier, [&]() -> bool {
+          return (header->published.load() > next || header->isClosed.load());
+        });
+        skipToMostRecent = true;
+      }
+      sequence = consumer.sequence;
+      return &cells[consumer.pinned].buffer;
+    }
+
+    /// pin the next consumable buffer, if any, see SwitchBufferImpl::Acquire
+    bool Acquire(Consumer &consumer, bool skipToMostRecent)
+    {
+      ConsumerCounters uncounted; // no statistics across processes
+      auto const isAcquired = protocol.Acquire(ring, header->published,
+        consumer.next, skipToMostRecent, consumer.pinned, uncounted);
+      if (isAcquired)
+        consumer.sequence = consumer.next - 1U;
+      return isAcquired;
+    }
+
+    void Unpin(Consumer &consumer)
+    {
+      if (consumer.pinned != none) {
+        protocol.Unpin(consumer.pinned);
+        consumer.pinned = none;
+      }
+    }
+
+    std::uint32_t Spare(Producer &producer)
+    {
+      // with a spare per consumer and consumers pinning one cell at a time,
+      // a spare is at most on its way back from the consumer unpinning it
+      auto index = protocol.TakeSpare(producer.spares);
+      while (index == none) {
+        std::this_thread::yield();
+        index = protocol.TakeSpare(producer.spares);
+      }
+      return index;
+    }
+  };
+
+  template<typename Buffer>
+  constexpr std::uint64_t SharedSwitchBufferImpl<Buffer>::tag;
+
+  template<typename Buffer>
+  constexpr std::uint32_t SharedSwitchBufferImpl<Buffer>::none;
+
+  template<typename Buffer>
+  constexpr bool SharedSwitchBufferImpl<Buffer>::Cell::isConstructed;
+} // namespace detail
+
+template<typename Buffer>
+SharedSwitchBufferProducer<Buffer>::~SharedSwitchBufferProducer()
+{
+  m_impl->CloseProducer(m_state);
+}
+
+template<typename Buffer>
+Buffer &SharedSwitchBufferProducer<Buffer>::Switch()
+{
+  return m_impl->SwitchProducer(m_state);
+}
+
+template<typename Buffer>
+SharedSwitchBufferProducer<Buffer>::SharedSwitchBufferProducer(
+  std::shared_ptr<detail::SharedSwitchBufferImpl<Buffer>> impl)
+  : m_impl(std::move(impl))
+  , m_state(m_impl->CreateProducer())
+{}
+
+
+template<typename Buffer>
+SharedSwitchBufferConsumer<Buffer>::~SharedSwitchBufferConsumer()
+{
+  m_impl->CloseConsumer(m_state);
+}
+
+template<typename Buffer>
+typename SharedSwitchBufferConsumer<Buffer>::Result
+SharedSwitchBufferConsumer<Buffer>::SwitchWait(bool skipToMostRecent)
+{
+  std::uint64_t sequence = 0U;
+  auto const buffer = m_impl->SwitchConsumerWait(m_state, skipToMostRecent, m_waitStrategy, sequence);
+  return Result{(buffer ? SwitchStatus::Ready : SwitchStatus::Closed), buffer, sequence};
+}
+
+template<typename Buffer>
+void SharedSwitchBufferConsumer<Buffer>::SetWaitStrategy(WaitStrategy waitStrategy) noexcept
+{
+  m_waitStrategy = waitStrategy;
+}
+
+template<typename Buffer>
+SharedSwitchBufferConsumer<Buffer>::SharedSwitchBufferConsumer(
+  std::shared_ptr<detail::SharedSwitchBufferImpl<Buffer>> impl, WaitStrategy waitStrategy)
+  : m_impl(std::move(impl))
+  , m_state(m_impl->CreateConsumer())
+  , m_waitStrategy(waitStrategy)
+{}
+
+
+template<typename Buffer>
+SharedSwitchBuffer<Buffer>::SharedSwitchBuffer(std::string const &name,
+  size_t ringBufferSize, size_t maxConsumers)
+  : m_impl(std::make_shared<detail::SharedSwitchBufferImpl<Buffer>>(name, ringBufferSize, maxConsumers))
+{}
+
+template<typename Buffer>
+SharedSwitchBuffer<Buffer>::SharedSwitchBuffer(std::string const &name)
+  : m_impl(std::make_shared<detail::SharedSwitchBufferImpl<Buffer>>(name))
+{}
+
+template<typename Buffer>
+typename SharedSwitchBuffer<Buffer>::Producer SharedSwitchBuffer<Buffer>::GetProducer()
+{
+  return Producer(new SharedSwitchBufferProducer<Buffer>(m_impl));
+}
+
+template<typename Buffer>
+typename SharedSwitchBuffer<Buffer>::Consumer SharedSwitchBuffer<Buffer>::GetConsumer(
+  WaitStrategy waitStrategy)
+{
+  return Consumer(new SharedSwitchBufferConsumer<Buffer>(m_impl, waitStrategy));
+}
+
+#endif // SWITCHBUFFER_SHM_IMPL_H
@@ -0,0 +1,164 @@
+#include "switchbuffer_shm.h"
+
+#include <cstdlib>         // for EXIT_SUCCESS
+#include <iostream>        // for std::cerr
+#include <stdexcept>       // for std::logic_error
+#include <string>          // for std::to_string
+
+#include <sys/wait.h>      // for waitpid
+#include <unistd.h>        // for fork
+
+#define ITERATIONS 100000U
+
+using namespace std;
+using Buffer = SharedSwitchBuffer<unsigned int>;
+
+static unsigned int failures = 0U;                           ///< Number of failed checks
+
+/// Report a failed check without aborting the remaining ones
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+      ++failures; \
+    } \
+  } while (false)
+
+/// Segment name unique to this process and test
+string Name(char const *test)
+{
+  return "/switchbuffer_unittest_" + to_string(getpid()) + "_" + test;
+}
+
+/// A buffer in consumption survives the producer lapping the ring
+void TestOverwriteProtection()
+{
+  Buffer sbuf(Name("overwrite"), 4U, 1U);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  producer->Switch() = 1000U;
+  (void)producer->Switch();
+  auto const pinned = consumer->SwitchWait();
+  CHECK(pinned && *pinned.buffer == 1000U && pinned.sequence == 0U);
+
+  for (unsigned int i = 0U; i < 20U; ++i)
+    producer->Switch() = i;
+  CHECK(*pinned.buffer == 1000U);
+
+  // continues with the oldest buffer not overwritten yet
+  (void)producer->Switch();
+  auto const next = consumer->SwitchWait();
+  CHECK(next && *next.buffer == 17U && next.sequence == 19U);
+
+  auto const recent = consumer->SwitchWait(true);
+  CHECK(recent && *recent.buffer == 19U && recent.sequence == 21U);
+
+  producer.reset();
+  CHECK(consumer->SwitchWait().status == SwitchStatus::Closed);
+}
+
+/// Attaching checks the buffer type, and the producer and consumer seats are limited
+void TestAttach()
+{
+  auto const name = Name("attach");
+  Buffer sbuf(name, 4U, 1U);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  Buffer attached(name);
+  bool isRejected = false;
+  try {
+    (void)attached.GetProducer();
+  } catch (logic_error const &) {
+    isRejected = true;
+  }
+  CHECK(isRejected);
+
+  isRejected = false;
+  try {
+    (void)attached.GetConsumer();
+  } catch (logic_error const &) {
+    isRejected = true;
+  }
+  CHECK(isRejected);
+
+  isRejected = false;
+  try {
+    SharedSwitchBuffer<double> mismatched(name);
+  } catch (runtime_error const &) {
+    isRejected = true;
+  }
+  CHECK(isRejected);
+
+  // the seat is free again once its consumer is gone,
+  // and a consumer attaching late starts with the next buffer to be published
+  producer->Switch() = 1U;
+  producer->Switch() = 2U;
+  producer->Switch() = 3U;
+  consumer.reset();
+  auto late = attached.GetConsumer();
+  CHECK(late != nullptr);
+  producer->Switch() = 4U;
+  auto const result = late->SwitchWait();
+  CHECK(result && *result.buffer == 3U && result.sequence == 2U);
+}
+
+/// A consumer in another process gets the buffers in production order, then sees it closed
+void TestProcesses()
+{
+  auto const name = Name("processes");
+  Buffer sbuf(name, 8U, 1U);
+
+  int ready[2];
+  CHECK(pipe(ready) == 0);
+
+  auto const pid = fork();
+  if (pid == 0) {
+    // consumer process, reporting via its exit code
+    Buffer attached(name);
+    auto consumer = attached.GetConsumer();
+    char const signal = 1;
+    (void)write(ready[1], &signal, 1U);
+
+    unsigned int count = 0U;
+    unsigned int last = 0U;
+    bool isOrdered = true;
+    while (auto const result = consumer->SwitchWait()) {
+      isOrdered = isOrdered && (count == 0U || *result.buffer > last) &&
+        *result.buffer == result.sequence + 1U;
+      last = *result.buffer;
+      ++count;
+    }
+    _exit(isOrdered && count > 0U && last == ITERATIONS ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+  CHECK(pid > 0);
+
+  char signal;
+  CHECK(read(ready[0], &signal, 1U) == 1);
+  (void)close(ready[0]);
+  (void)close(ready[1]);
+
+  auto producer = sbuf.GetProducer();
+  for (unsigned int i = 1U; i <= ITERATIONS; ++i)
+    producer->Switch() = i;
+  (void)producer->Switch();
+  producer.reset();
+
+  int status = 0;
+  CHECK(waitpid(pid, &status, 0) == pid);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+int main(int, char **)
+{
+  TestOverwriteProtection();
+  TestAttach();
+  TestProcesses();
+
+  if (failures != 0U) {
+    cerr << failures << " checks failed\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,761 @@
+#include "switchbuffer.h"
+
+#include <atomic>          // for std::atomic
+#include <chrono>          // for std::chrono::milliseconds
+#include <cstdint>         // for std::uint64_t, std::uintptr_t
+#include <cstdlib>         // for EXIT_SUCCESS
+#include <future>          // for std::future_error
+#include <iostream>        // for std::cerr
+#include <stdexcept>       // for std::logic_error
+#include <thread>          // for std::thread
+#include <vector>          // for std::vector
+
+#ifdef SWITCHBUFFER_EVENTFD
+  #include <poll.h>        // for poll
+#endif
+
+#define ITERATIONS 100000U
+#define PRODUCER_COUNT 4U
+
+using namespace std;
+using Buffer = SwitchBuffer<unsigned int>;
+
+static unsigned int failures = 0U;                           ///< Number of failed checks
+
+/// Report a failed check without aborting the remaining ones
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition "\n"; \
+      ++failures; \
+    } \
+  } while (false)
+
+/// Buffers are consumed in production order, numbered consecutively
+void TestOrdering()
+{
+  Buffer sbuf(8);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  for (unsigned int i = 0U; i < 6U; ++i)
+    producer->Switch() = i;
+
+  for (unsigned int i = 0U; i < 5U; ++i) {
+    auto const result = consumer->SwitchWait();
+    CHECK(result.status == SwitchStatus::Ready);
+    CHECK(*result.buffer == i);
+    CHECK(result.sequence == i);
+  }
+  CHECK(consumer->TrySwitch().status == SwitchStatus::Empty);
+
+  // futures and batches carry the sequence numbers as well
+  producer->Switch() = 6U;
+  auto future = consumer->Switch();
+  CHECK(future.get() == 5U);
+  CHECK(consumer->GetSequence() == 5U);
+
+  producer->Switch() = 7U;
+  producer->Switch() = 8U;
+  (void)producer->Switch();
+  auto const batch = consumer->SwitchBatch();
+  CHECK(batch.size() == 3U);
+  for (size_t pos = 0U; pos < batch.size(); ++pos)
+    CHECK(batch[pos] == 6U + pos && batch.sequence(pos) == 6U + pos);
+  CHECK(consumer->GetSequence() == 8U);
+
+  // a switch without a buffer leaves the sequence number of the last one
+  CHECK(consumer->SwitchFor(chrono::milliseconds(1)).status == SwitchStatus::Empty);
+  CHECK(consumer->GetSequence() == 8U);
+}
+
+/// @brief  produce and consume in lockstep over several laps of the ring,
+///         then let the producer lap the consumer
+template<typename SwitchBufferType>
+void CheckLaps(SwitchBufferType &sbuf, unsigned int ringSize)
+{
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  for (unsigned int i = 0U; i < 5U * ringSize; ++i) {
+    producer->Switch() = i;
+    if (i > 0U) {
+      auto const result = consumer->TrySwitch();
+      CHECK(result && *result.buffer == i - 1U && result.sequence == i - 1U);
+    }
+  }
+
+  // the oldest buffer not overwritten yet comes next
+  for (unsigned int i = 0U; i < 2U * ringSize; ++i)
+    producer->Switch() = 5U * ringSize + i;
+  (void)producer->Switch();
+  auto const result = consumer->TrySwitch();
+  CHECK(result && result.sequence == 7U * ringSize - ringSize + 1U && *result.buffer == result.sequence);
+}
+
+/// Rings of power-of-two size index by bitmask, and reject other sizes
+void TestPowerOfTwo()
+{
+  Buffer sbuf(8, true);
+  CheckLaps(sbuf, 8U);
+
+  bool isRejected = false;
+  try {
+    Buffer invalid(6, true);
+  } catch (logic_error const &) {
+    isRejected = true;
+  }
+  CHECK(isRejected);
+}
+
+/// Rings of compile-time size behave like the ones of runtime size
+void TestCompileTimeSize()
+{
+  SwitchBuffer<unsigned int, 4U> sbuf;
+  CheckLaps(sbuf, 4U);
+
+  SwitchBuffer<unsigned int, 5U> odd;
+  CheckLaps(odd, 5U);
+}
+
+/// Consumers wait on an empty ring with each wait strategy, seeing every wakeup and the close
+void TestWaitStrategies()
+{
+  WaitStrategy::Mode const modes[] = {
+    WaitStrategy::BusySpin, WaitStrategy::SpinYield, WaitStrategy::SpinPark, WaitStrategy::TimedPark};
+  for (auto &&mode : modes) {
+    Buffer sbuf(8);
+    auto producer = sbuf.GetProducer();
+    auto consumer = sbuf.GetConsumer(WaitStrategy(mode, 16U, chrono::microseconds(50)));
+
+    thread producerThread([&producer]() {
+      for (unsigned int i = 1U; i <= 1000U; ++i) {
+        producer->Switch() = i;
+        if (i % 100U == 0U)
+          this_thread::sleep_for(chrono::milliseconds(1));
+      }
+      (void)producer->Switch();
+      producer.reset();
+    });
+
+    unsigned int last = 0U;
+    bool isOrdered = true;
+    while (auto const result = consumer->SwitchWait()) {
+      isOrdered = isOrdered && *result.buffer > last;
+      last = *result.buffer;
+    }
+    CHECK(isOrdered);
+    CHECK(last == 1000U);
+    producerThread.join();
+  }
+}
+
+/// A consumer created late starts with the next buffer to be published
+void TestLateConsumer()
+{
+  Buffer sbuf(4);
+  auto producer = sbuf.GetProducer();
+  producer->Switch() = 1U;
+  producer->Switch() = 2U;
+
+  auto consumer = sbuf.GetConsumer();
+  auto future = consumer->Switch();
+  CHECK(future.wait_for(chrono::seconds(0)) == future_status::timeout);
+  (void)producer->Switch();
+  CHECK(future.get() == 2U);
+}
+
+/// A buffer in consumption survives the producer lapping the ring,
+/// and the buffers overwritten meanwhile show as a gap in the sequence numbers
+void TestOverwriteProtection()
+{
+  Buffer sbuf(4);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  producer->Switch() = 1000U;
+  (void)producer->Switch();
+  auto const pinned = consumer->SwitchWait();
+  CHECK(pinned && *pinned.buffer == 1000U);
+
+  for (unsigned int i = 0U; i < 20U; ++i)
+    producer->Switch() = i;
+  CHECK(*pinned.buffer == 1000U);
+
+  (void)producer->Switch();
+  auto const next = consumer->SwitchWait();
+  CHECK(next.status == SwitchStatus::Ready);
+  CHECK(next.sequence > pinned.sequence + 1U);
+  CHECK(*next.buffer == next.sequence - 2U);
+
+  auto const recent = consumer->SwitchWait(true);
+  CHECK(recent.status == SwitchStatus::Ready);
+  CHECK(recent.sequence == 21U && *recent.buffer == 19U);
+}
+
+/// A reliable consumer gets every buffer, throttling the producer
+void TestReliable()
+{
+  Buffer sbuf(4);
+  auto consumer = sbuf.GetConsumer(WaitStrategy(), ConsumerMode::Reliable);
+  auto lossy = sbuf.GetConsumer();
+  auto producer = sbuf.GetProducer();
+
+  // the ring fills up without the reliable consumer consuming
+  unsigned int count = 0U;
+  while (auto const buffer = producer->TrySwitch())
+    *buffer = count++;
+  CHECK(count == 3U);
+
+  thread producerThread([&producer]() {
+    for (unsigned int i = 3U; i < ITERATIONS; ++i)
+      producer->Switch() = i;
+    (void)producer->Switch();
+    producer.reset();
+  });
+
+  unsigned int expected = 0U;
+  while (auto const result = consumer->SwitchWait()) {
+    CHECK(*result.buffer == expected);
+    CHECK(result.sequence == expected);
+    expected = *result.buffer + 1U;
+  }
+  CHECK(expected == ITERATIONS);
+  producerThread.join();
+}
+
+/// Several reliable consumers each get every buffer, also while others leave
+void TestReliableConsumers()
+{
+  Buffer sbuf(8);
+  auto producer = sbuf.GetProducer();
+
+  vector<Buffer::Consumer> handles;
+  for (unsigned int c = 0U; c < 5U; ++c)
+    handles.push_back(sbuf.GetConsumer(WaitStrategy(), ConsumerMode::Reliable));
+
+  vector<thread> consumers;
+  vector<unsigned int> counts(handles.size(), 0U);
+  for (unsigned int c = 0U; c < handles.size(); ++c) {
+    consumers.emplace_back([c, &counts](Buffer::Consumer consumer) {
+      // the first one leaves halfway, the others consume at different paces
+      unsigned int expected = 0U;
+      while (auto const result = consumer->SwitchWait()) {
+        if (*result.buffer != expected)
+          break;
+        ++expected;
+        if (c == 0U && expected == ITERATIONS / 20U)
+          break;
+        if (expected % (c + 1U) == 0U)
+          this_thread::yield();
+      }
+      counts[c] = expected;
+    }, move(handles[c]));
+  }
+
+  for (unsigned int i = 0U; i < ITERATIONS / 10U; ++i)
+    producer->Switch() = i;
+  (void)producer->Switch();
+  producer.reset();
+
+  for (auto &&t : consumers)
+    t.join();
+  CHECK(counts[0] == ITERATIONS / 20U);
+  for (unsigned int c = 1U; c < counts.size(); ++c)
+    CHECK(counts[c] == ITERATIONS / 10U);
+}
+
+/// All buffers of all producers arrive, each in its producer's order
+void TestMultiProducer()
+{
+  Buffer sbuf(16, false, ProducerMode::Multi);
+  auto consumer = sbuf.GetConsumer(WaitStrategy(), ConsumerMode::Reliable);
+
+  vector<thread> producers;
+  for (unsigned int p = 0U; p < PRODUCER_COUNT; ++p) {
+    producers.emplace_back([p](Buffer::Producer producer) {
+      for (unsigned int i = 0U; i < ITERATIONS; ++i)
+        producer->Switch() = p * ITERATIONS + i;
+
+      // taken, but closed rather than published by another switch
+      producer->Switch() = ~0U;
+    }, sbuf.GetProducer());
+  }
+
+  vector<unsigned int> next(PRODUCER_COUNT, 0U);
+  uint64_t sequence = 0U;
+  while (auto const result = consumer->SwitchWait()) {
+    CHECK(*result.buffer != ~0U);
+    CHECK(result.sequence >= sequence);
+    sequence = result.sequence;
+
+    auto const p = *result.buffer / ITERATIONS;
+    CHECK(p < PRODUCER_COUNT);
+    if (p < PRODUCER_COUNT) {
+      CHECK(*result.buffer % ITERATIONS == next[p]);
+      ++next[p];
+    }
+  }
+  for (auto &&count : next)
+    CHECK(count == ITERATIONS);
+
+  for (auto &&t : producers)
+    t.join();
+}
+
+/// Producers trying to switch keep going while reliable consumers come and go
+void TestMultiProducerTrySwitch()
+{
+  Buffer sbuf(PRODUCER_COUNT, false, ProducerMode::Multi);
+
+  vector<Buffer::Producer> handles;
+  for (unsigned int p = 0U; p < PRODUCER_COUNT; ++p)
+    handles.push_back(sbuf.GetProducer());
+
+  atomic<bool> isDone(false);
+  thread churn([&sbuf, &isDone]() {
+    while (!isDone) {
+      auto consumer = sbuf.GetConsumer(WaitStrategy(), ConsumerMode::Reliable);
+      for (unsigned int i = 0U; i < 4U; ++i)
+        (void)consumer->TrySwitch();
+    }
+  });
+
+  vector<thread> producers;
+  for (auto &&handle : handles) {
+    producers.emplace_back([](Buffer::Producer producer) {
+      for (unsigned int i = 0U; i < ITERATIONS / 10U; ++i) {
+        unsigned int *buffer;
+        while (!(buffer = producer->TrySwitch()))
+          this_thread::yield();
+        *buffer = i;
+      }
+    }, move(handle));
+  }
+  for (auto &&t : producers)
+    t.join();
+  isDone = true;
+  churn.join();
+
+  CHECK(sbuf.GetConsumer()->TrySwitch().status == SwitchStatus::Closed);
+}
+
+/// A producer batch is published at once, and Publish publishes without claiming more
+void TestProducerBatch()
+{
+  Buffer sbuf(8);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  auto batch = producer->SwitchBatch(3U);
+  CHECK(batch.size() == 3U);
+  unsigned int value = 1U;
+  for (auto &&buffer : batch)
+    buffer = value++;
+  CHECK(consumer->TrySwitch().status == SwitchStatus::Empty);
+
+  producer->Publish();
+  producer->Publish(); // nothing left to publish
+  auto const consumed = consumer->SwitchBatch();
+  CHECK(consumed.size() == 3U);
+  for (size_t pos = 0U; pos < consumed.size(); ++pos)
+    CHECK(consumed[pos] == pos + 1U && consumed.sequence(pos) == pos);
+
+  producer->Switch() = 4U;
+  producer->Publish();
+  auto const result = consumer->TrySwitch();
+  CHECK(result && *result.buffer == 4U && result.sequence == 3U);
+
+  bool isRejected = false;
+  try {
+    (void)producer->SwitchBatch(8U);
+  } catch (logic_error const &) {
+    isRejected = true;
+  }
+  CHECK(isRejected);
+
+  // with several producers, a buffer held back delays the later ones until published
+  Buffer multi(8, false, ProducerMode::Multi);
+  auto first = multi.GetProducer();
+  auto second = multi.GetProducer();
+  auto observer = multi.GetConsumer();
+  first->Switch() = 1U;
+  second->Switch() = 2U;
+  second->Publish();
+  CHECK(observer->TrySwitch().status == SwitchStatus::Empty);
+  first->Publish();
+  auto next = observer->TrySwitch();
+  CHECK(next && *next.buffer == 1U);
+  next = observer->TrySwitch();
+  CHECK(next && *next.buffer == 2U);
+}
+
+/// Consumers count what they consumed, missed and waited for, if statistics are compiled in
+void TestStatistics()
+{
+  Buffer sbuf(4);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  for (unsigned int i = 0U; i < 10U; ++i)
+    producer->Switch() = i;
+  (void)producer->Switch();
+
+  auto result = consumer->TrySwitch();
+  CHECK(result && *result.buffer == 7U);
+  result = consumer->TrySwitch(true);
+  CHECK(result && *result.buffer == 9U);
+  CHECK(consumer->SwitchFor(chrono::milliseconds(1)).status == SwitchStatus::Empty);
+
+  {
+    auto other = sbuf.GetConsumer();
+    (void)producer->Switch();
+    CHECK(other->TrySwitch());
+  }
+
+  auto const stats = consumer->GetStatistics();
+  auto const sum = sbuf.GetStatistics();
+#ifdef SWITCHBUFFER_STATISTICS
+  CHECK(stats.consumed == 2U);
+  CHECK(stats.overwritten == 7U);
+  CHECK(stats.skipped == 1U);
+  CHECK(stats.blocked == 1U && stats.blockedTime >= chrono::milliseconds(1));
+  CHECK(sum.consumed == 3U); // including the closed consumer
+#else
+  CHECK(stats.consumed == 0U && stats.overwritten == 0U && stats.blocked == 0U);
+  CHECK(sum.consumed == 0U);
+#endif // SWITCHBUFFER_STATISTICS
+}
+
+/// Buffer without a default constructor, optionally failing to construct
+struct Frame
+{
+  unsigned int value;
+
+  explicit Frame(unsigned int value, bool shouldThrow = false)
+    : value(value)
+  {
+    if (shouldThrow)
+      throw runtime_error("Frame: construction failed");
+  }
+};
+
+/// Buffers are constructed in place, a buffer failing to construct is skipped,
+/// and previous contents are reset in place for reuse
+void TestEmplace()
+{
+  SwitchBuffer<Frame> sbuf(4);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  CHECK(producer->Emplace(1U).value == 1U);
+  bool isThrown = false;
+  try {
+    (void)producer->Emplace(2U, true);
+  } catch (runtime_error const &) {
+    isThrown = true;
+  }
+  CHECK(isThrown);
+  (void)producer->Emplace(3U);
+  (void)producer->Emplace(4U);
+
+  auto result = consumer->TrySwitch();
+  CHECK(result && result.buffer->value == 1U && result.sequence == 0U);
+  result = consumer->TrySwitch();
+  CHECK(result && result.buffer->value == 3U && result.sequence == 2U);
+  CHECK(consumer->TrySwitch().status == SwitchStatus::Empty);
+
+  SwitchBuffer<vector<unsigned int>> reused(2);
+  auto vectorProducer = reused.GetProducer();
+  unsigned int resets = 0U;
+  auto const reset = [&resets](vector<unsigned int> &buffer) {
+    CHECK(buffer.size() == 1U);
+    buffer.clear();
+    ++resets;
+  };
+  for (unsigned int i = 0U; i < 4U; ++i) {
+    auto &&buffer = vectorProducer->Switch(reset);
+    CHECK(buffer.empty());
+    buffer.push_back(i);
+  }
+
+  // the first lap is default-constructed rather than reset, later ones keep their capacity
+  CHECK(resets == 2U);
+  CHECK(vectorProducer->Switch(reset).capacity() >= 1U);
+}
+
+/// Memory resource counting the memory it hands out, on top of the default one
+class CountingResource : public SwitchBufferMemoryResource
+{
+public:
+  size_t allocations = 0U;
+  size_t outstanding = 0U; ///< bytes allocated, but not deallocated yet
+  bool isAligned = true; ///< flag whether all allocations were aligned as requested
+
+private:
+  void *do_allocate(size_t bytes, size_t alignment) override
+  {
+    auto const p = detail::DefaultMemoryResource()->allocate(bytes, alignment);
+    isAligned = isAligned && reinterpret_cast<uintptr_t>(p) % alignment == 0U;
+    ++allocations;
+    outstanding += bytes;
+    return p;
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override
+  {
+    outstanding -= bytes;
+    detail::DefaultMemoryResource()->deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(SwitchBufferMemoryResource const &other) const noexcept override
+  {
+    return (this == &other);
+  }
+};
+
+/// All shared state comes from the memory resource and is returned to it
+void TestMemoryResource()
+{
+  CountingResource resource;
+  {
+    Buffer sbuf(4, false, ProducerMode::Single, &resource);
+    auto producer = sbuf.GetProducer();
+    auto consumer = sbuf.GetConsumer();
+    CHECK(resource.allocations > 0U);
+
+    // lapping a pinned buffer takes a spare from the resource
+    producer->Switch() = 1U;
+    (void)producer->Switch();
+    auto const pinned = consumer->SwitchWait();
+    auto const allocations = resource.allocations;
+    for (unsigned int i = 0U; i < 8U; ++i)
+      producer->Switch() = i;
+    CHECK(resource.allocations > allocations);
+    CHECK(pinned && *pinned.buffer == 1U);
+
+    SwitchBuffer<unsigned int, 4U> fixed(ProducerMode::Single, &resource);
+    CheckLaps(fixed, 4U);
+  }
+  CHECK(resource.isAligned);
+  CHECK(resource.outstanding == 0U);
+}
+
+/// Consumers drain the remaining buffers once the producer is gone, then see it closed
+void TestClose()
+{
+  Buffer sbuf(8);
+  auto producer = sbuf.GetProducer();
+  auto waiting = sbuf.GetConsumer();
+  auto draining = sbuf.GetConsumer();
+  auto batching = sbuf.GetConsumer();
+
+  auto future = waiting->Switch();
+  producer->Switch() = 1U;
+  producer->Switch() = 2U;
+  producer->Switch() = 3U; // taken, but never published
+  CHECK(future.get() == 1U);
+  future = waiting->Switch();
+  CHECK(future.get() == 2U);
+  future = waiting->Switch();
+  producer.reset();
+
+  // an open promise breaks
+  bool isBroken = false;
+  try {
+    (void)future.get();
+  } catch (future_error const &) {
+    isBroken = true;
+  }
+  CHECK(isBroken);
+
+  auto result = draining->SwitchWait();
+  CHECK(result && *result.buffer == 1U);
+  result = draining->TrySwitch();
+  CHECK(result && *result.buffer == 2U);
+  CHECK(draining->SwitchWait().status == SwitchStatus::Closed);
+  CHECK(draining->TrySwitch().status == SwitchStatus::Closed);
+  CHECK(draining->SwitchFor(chrono::hours::max()).status == SwitchStatus::Closed);
+
+  auto const batch = batching->SwitchBatch();
+  CHECK(batch && batch.size() == 2U);
+  CHECK(batching->SwitchBatch().status == SwitchStatus::Closed);
+}
+
+/// Timed switches return empty-handed on timeout and with a buffer otherwise
+void TestTimed()
+{
+  Buffer sbuf(4);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer(WaitStrategy(WaitStrategy::SpinPark, 10U));
+
+  auto const start = chrono::steady_clock::now();
+  CHECK(consumer->SwitchFor(chrono::milliseconds(20)).status == SwitchStatus::Empty);
+  CHECK(chrono::steady_clock::now() - start >= chrono::milliseconds(20));
+
+  thread producerThread([&producer]() {
+    this_thread::sleep_for(chrono::milliseconds(20));
+    producer->Switch() = 1U;
+    producer->Switch() = 2U;
+  });
+  auto result = consumer->SwitchFor(chrono::hours::max());
+  CHECK(result && *result.buffer == 1U);
+  producerThread.join();
+
+  // narrow representations neither overflow nor wait forever
+  using IntMilliseconds = chrono::duration<int, milli>;
+  auto const narrowStart = chrono::steady_clock::now();
+  CHECK(consumer->SwitchFor(IntMilliseconds(20)).status == SwitchStatus::Empty);
+  auto const elapsed = chrono::steady_clock::now() - narrowStart;
+  CHECK(elapsed >= chrono::milliseconds(20) && elapsed < chrono::seconds(10));
+
+  producerThread = thread([&producer]() {
+    this_thread::sleep_for(chrono::milliseconds(20));
+    producer->Switch() = 3U;
+  });
+  result = consumer->SwitchFor(IntMilliseconds::max());
+  CHECK(result && *result.buffer == 2U);
+  producerThread.join();
+
+  // deadlines, near and indefinite
+  auto const deadline = chrono::steady_clock::now() + chrono::milliseconds(20);
+  CHECK(consumer->SwitchUntil(deadline).status == SwitchStatus::Empty);
+  CHECK(chrono::steady_clock::now() >= deadline);
+
+  producerThread = thread([&producer]() {
+    this_thread::sleep_for(chrono::milliseconds(20));
+    (void)producer->Switch();
+  });
+  result = consumer->SwitchUntil(chrono::system_clock::time_point::max());
+  CHECK(result && *result.buffer == 3U);
+  producerThread.join();
+
+  producer.reset();
+  CHECK(consumer->SwitchUntil(chrono::steady_clock::now() + chrono::hours(1)).status == SwitchStatus::Closed);
+}
+
+/// Callbacks see every buffer, inline or once demoted
+void TestCallback()
+{
+  Buffer sbuf(64);
+  auto producer = sbuf.GetProducer();
+
+  atomic<uint64_t> fastSum(0U);
+  atomic<uint64_t> slowSum(0U);
+  auto fast = sbuf.GetCallbackConsumer([&fastSum](unsigned int const &value) {
+    fastSum += value;
+  });
+  auto slow = sbuf.GetCallbackConsumer([&slowSum](unsigned int const &value) {
+    if (value == 1U)
+      this_thread::sleep_for(chrono::milliseconds(5));
+    slowSum += value;
+  }, chrono::milliseconds(1));
+
+  for (unsigned int i = 1U; i <= 10U; ++i)
+    producer->Switch() = i;
+  (void)producer->Switch();
+  CHECK(fastSum == 55U);
+  CHECK(!fast->IsDemoted());
+  CHECK(slow->IsDemoted());
+
+  for (unsigned int i = 0U; i < 100U && slowSum != 55U; ++i)
+    this_thread::sleep_for(chrono::milliseconds(10));
+  CHECK(slowSum == 55U);
+}
+
+#ifdef SWITCHBUFFER_EVENTFD
+/// The file descriptor is readable while a buffer is available
+void TestFileDescriptor()
+{
+  Buffer sbuf(4);
+  auto producer = sbuf.GetProducer();
+  auto consumer = sbuf.GetConsumer();
+
+  pollfd pfd{consumer->GetFileDescriptor(), POLLIN, 0};
+  CHECK(poll(&pfd, 1, 0) == 0);
+
+  producer->Switch() = 1U;
+  (void)producer->Switch();
+  CHECK(poll(&pfd, 1, 0) == 1);
+
+  CHECK(consumer->TrySwitch());
+  CHECK(poll(&pfd, 1, 0) == 0);
+
+  producer.reset();
+  CHECK(poll(&pfd, 1, 0) == 1);
+}
+#endif // SWITCHBUFFER_EVENTFD
+
+#ifdef SWITCHBUFFER_COROUTINE
+/// Coroutine that neither suspends initially nor finally
+struct Task
+{
+  struct promise_type
+  {
+    Task get_return_object() { return {}; }
+    suspend_never initial_suspend() { return {}; }
+    suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { terminate(); }
+  };
+};
+
+Task Consume(Buffer::Consumer consumer, vector<unsigned int> &values, bool &isClosed)
+{
+  while (auto const result = co_await consumer->Next())
+    values.push_back(*result.buffer);
+  isClosed = true;
+}
+
+/// A suspended coroutine is resumed by the producer
+void TestCoroutine()
+{
+  Buffer sbuf(4);
+  auto producer = sbuf.GetProducer();
+
+  vector<unsigned int> values;
+  bool isClosed = false;
+  Consume(sbuf.GetConsumer(), values, isClosed);
+  CHECK(values.empty());
+
+  producer->Switch() = 1U;
+  producer->Switch() = 2U;
+  (void)producer->Switch();
+  producer.reset();
+  CHECK(isClosed);
+  CHECK(values == vector<unsigned int>({1U, 2U}));
+}
+#endif // SWITCHBUFFER_COROUTINE
+
+int main(int, char **)
+{
+  TestOrdering();
+  TestPowerOfTwo();
+  TestCompileTimeSize();
+  TestLateConsumer();
+  TestWaitStrategies();
+  TestOverwriteProtection();
+  TestReliable();
+  TestReliableConsumers();
+  TestMultiProducer();
+  TestMultiProducerTrySwitch();
+  TestProducerBatch();
+  TestStatistics();
+  TestEmplace();
+  TestMemoryResource();
+  TestClose();
+  TestTimed();
+  TestCallback();
+#ifdef SWITCHBUFFER_EVENTFD
+  TestFileDescriptor();
+#endif
+#ifdef SWITCHBUFFER_COROUTINE
+  TestCoroutine();
+#endif
+
+  if (failures != 0U) {
+    cerr << failures << " checks failed\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}